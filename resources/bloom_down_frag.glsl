@@ -0,0 +1,35 @@
+#version 330 core
+out vec4 frag_colour;
+
+in vec2 v_tex_coords;
+
+uniform sampler2D image;
+uniform vec2      uv_scale;
+
+vec2 half_texel;
+
+// Taps outside the used part of the image would pick 
+// up stale pixels, so clamp them to its edge instead
+vec3 tap(vec2 offset)
+{
+    vec2 uv = min(v_tex_coords + offset, uv_scale - half_texel);
+    return texture(image, uv).rgb;
+}
+
+// Halves the image. The centre tap falls between four source texels,
+// and the diagonal taps a whole source texel away each average another
+// 2x2 block, so the five taps cover a 4x4 texel area of the source,
+// weighted towards the centre.
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(image, 0));
+    half_texel = texel * 0.5;
+
+    vec3 result = tap(vec2(0.0)) * 4.0;
+    result += tap(vec2(-texel.x, -texel.y));
+    result += tap(vec2( texel.x, -texel.y));
+    result += tap(vec2(-texel.x,  texel.y));
+    result += tap(vec2( texel.x,  texel.y));
+
+    frag_colour = vec4(result / 8.0, 1.0);
+}
@@ -0,0 +1,36 @@
+#version 330 core
+out vec4 frag_colour;
+
+in vec2 v_tex_coords;
+
+uniform sampler2D image;
+uniform vec2      uv_scale;
+
+vec2 half_texel;
+
+// Taps outside the used part of the image would pick 
+// up stale pixels, so clamp them to its edge instead
+vec3 tap(vec2 offset)
+{
+    vec2 uv = min(v_tex_coords + offset, uv_scale - half_texel);
+    return texture(image, uv).rgb;
+}
+
+// Doubles the image with a tent filter made of eight bilinear taps.
+// The result is added onto the next larger level of the chain.
+void main()
+{
+    half_texel = 0.5 / vec2(textureSize(image, 0));
+
+    vec3 result = vec3(0.0);
+    result += tap(vec2(-half_texel.x * 2.0, 0.0));
+    result += tap(vec2( half_texel.x * 2.0, 0.0));
+    result += tap(vec2(0.0, -half_texel.y * 2.0));
+    result += tap(vec2(0.0,  half_texel.y * 2.0));
+    result += tap(vec2(-half_texel.x, -half_texel.y)) * 2.0;
+    result += tap(vec2( half_texel.x, -half_texel.y)) * 2.0;
+    result += tap(vec2(-half_texel.x,  half_texel.y)) * 2.0;
+    result += tap(vec2( half_texel.x,  half_texel.y)) * 2.0;
+
+    frag_colour = vec4(result / 12.0, 1.0);
+}
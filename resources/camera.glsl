@@ -0,0 +1,12 @@
+#version 330 core
+
+// Prepended to the shaders that draw in world space. 
+// Filled once per frame from CameraBlock in frontend.h.
+layout (std140) uniform Camera {
+    mat4  projection;
+    mat4  view;
+    vec4  camera_pos;
+    vec2  screen_size;
+    float near_clip;
+    float far_clip;
+};
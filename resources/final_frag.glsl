@@ -2,16 +2,20 @@
 out vec4 frag_colour;
 
 in vec2 v_tex_coords;
+in vec2 v_screen_coords;
 
 uniform sampler2D scene;
 uniform sampler2D bloom;
+uniform float     bloom_strength;   // 0 when bloom is off
+uniform vec2      bloom_uv_scale;   // uv_scale is for the scene
 const float exposure = 1.0;
 const float gamma = 2.2;
 
 void main()
 {             
     // Gamma correction
-    vec3 res = texture(scene, v_tex_coords).rgb + texture(bloom, v_tex_coords).rgb;
+    vec3 res = texture(scene, v_tex_coords).rgb 
+             + texture(bloom, v_screen_coords * bloom_uv_scale).rgb * bloom_strength;
     res = vec3(1.0) - exp(-res * exposure);
     res = pow(res, vec3(1.0 / gamma));
     frag_colour = vec4(res, 1.0);
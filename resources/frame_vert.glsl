@@ -2,10 +2,15 @@
 layout (location = 0) in vec2 a_position;
 layout (location = 1) in vec2 a_tex_coords;
 
+// The part of the source texture in use, see GLFrameBuffer::uv_scale
+uniform vec2 uv_scale;
+
 out vec2 v_tex_coords;
+out vec2 v_screen_coords;
 
 void main()
 {
-    v_tex_coords = a_tex_coords;
+    v_tex_coords    = a_tex_coords * uv_scale;
+    v_screen_coords = a_tex_coords;
     gl_Position = vec4(a_position.xy, 0.0, 1.0);
-}
\ No newline at end of file
+}
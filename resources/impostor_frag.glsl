@@ -0,0 +1,40 @@
+layout (location = 0) out vec4 frag_colour;
+layout (location = 1) out vec4 emitter_colour;
+
+in      vec3  v_view_pos;
+flat in vec3  v_view_centre;
+flat in float v_radius;
+flat in vec3  v_colour;
+flat in int   v_is_light;
+
+void main()
+{
+    // Cast a ray from the camera through the quad onto the sphere,
+    // all in view space where the camera is at the origin
+    vec3  ray  = normalize(v_view_pos);
+    float b    = dot(ray, v_view_centre);
+    float c    = dot(v_view_centre, v_view_centre) - v_radius * v_radius;
+    float disc = b * b - c;
+    if (disc < 0.0) {
+        discard;
+    }
+
+    vec3 hit  = ray * (b - sqrt(disc));
+    vec4 clip = projection * vec4(hit, 1.0);
+    gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+    if (v_is_light > 0) {
+        frag_colour    = vec4(v_colour, 1.0);
+        emitter_colour = frag_colour;
+        return;
+    }
+
+    // The view matrix is a rotation and translation, so its 
+    // inverse rotation is the transpose
+    mat3 to_world  = transpose(mat3(view));
+    vec3 normal    = to_world * ((hit - v_view_centre) / v_radius);
+    vec3 frag_pos  = to_world * (hit - view[3].xyz);
+
+    frag_colour    = vec4(reflector_body(normal, frag_pos, -hit.z, v_colour), 1.0);
+    emitter_colour = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,35 @@
+layout (location = 0) in vec2 a_corner;
+layout (location = 1) in mat4 a_model;
+layout (location = 5) in vec3 a_colour;
+layout (location = 6) in int  a_is_light;
+
+out      vec3  v_view_pos;
+flat out vec3  v_view_centre;
+flat out float v_radius;
+flat out vec3  v_colour;
+flat out int   v_is_light;
+
+void main() 
+{
+    // Bodies are uniformly scaled spheres, so the model
+    // matrix holds just the centre and the radius
+    vec3  centre = vec3(view * vec4(a_model[3].xyz, 1.0));
+    float radius = length(a_model[0].xyz);
+
+    // Face the quad towards the camera, sized to the cone of rays 
+    // that touch the sphere so it covers the whole silhouette
+    vec3 forward = normalize(centre);
+    vec3 up_hint = abs(forward.y) > 0.99 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right   = normalize(cross(forward, up_hint));
+    vec3 up      = cross(right, forward);
+
+    float dist_sq   = dot(centre, centre);
+    float half_size = radius * sqrt(dist_sq / max(dist_sq - radius * radius, 1e-6));
+
+    v_view_pos    = centre + (right * a_corner.x + up * a_corner.y) * half_size;
+    v_view_centre = centre;
+    v_radius      = radius;
+    v_colour      = a_colour;
+    v_is_light    = a_is_light;
+    gl_Position   = projection * vec4(v_view_pos, 1.0);
+}
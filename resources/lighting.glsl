@@ -0,0 +1,75 @@
+
+// Body shading, shared by the mesh and impostor body shaders.
+// Appended after camera.glsl.
+
+// Clustered lights, see light_clusters.h. Each light is two texels:
+// position and range, then colour. The grid holds an offset into the
+// index list and a light count for every cluster.
+uniform samplerBuffer  light_data;
+uniform usamplerBuffer light_grid;
+uniform usamplerBuffer light_indices;
+uniform ivec3          cluster_dims;
+
+float ambient_strength  = 0.2;
+float diffuse_strength  = 0.6;
+float specular_strength = 0.8;
+float shininess         = 32.0;
+vec3  dir_light_dir     = vec3(1.0, 1.0, 1.0);
+vec3  dir_light_colour  = vec3(0.5, 0.5, 0.5);
+
+vec3 calculate_light(vec3 light_dir, 
+                     vec3 light_colour,
+                     vec3 normal,
+                     vec3 frag_pos,
+                     vec3 colour)
+{
+    light_dir = normalize(light_dir);
+    
+    // Diffuse
+    float diffuse_mul = max(dot(normal, light_dir), 0.0);
+    vec3  diffuse     = light_colour * diffuse_mul * colour * diffuse_strength;
+
+    // Specular
+    vec3  view_dir     = normalize(camera_pos.xyz - frag_pos);
+    vec3  reflect_dir  = reflect(-light_dir, normal);
+    float specular_mul = pow(max(dot(view_dir, reflect_dir), 0.0), shininess);
+    vec3  specular     = light_colour * specular_mul * colour * specular_strength;
+
+    return diffuse + specular;
+}
+
+vec3 reflector_body(vec3 normal, vec3 frag_pos, float view_depth, vec3 colour)
+{
+    vec3 result = calculate_light(
+        dir_light_dir, dir_light_colour, normal, frag_pos, colour);
+
+    // Add ambient light
+    result += dir_light_colour * colour * ambient_strength;
+
+    // Find this fragment's cluster, with depth slices spaced
+    // logarithmically between the clip planes
+    ivec2 tile  = ivec2(gl_FragCoord.xy / screen_size * vec2(cluster_dims.xy));
+    int   slice = int(log(view_depth / near_clip) 
+                    / log(far_clip / near_clip) * float(cluster_dims.z));
+    tile  = clamp(tile, ivec2(0), cluster_dims.xy - 1);
+    slice = clamp(slice, 0, cluster_dims.z - 1);
+
+    int   cluster = (slice * cluster_dims.y + tile.y) * cluster_dims.x + tile.x;
+    uvec2 cell    = texelFetch(light_grid, cluster).xy;
+
+    for (uint i = 0u; i < cell.y; ++i) {
+        int  light     = int(texelFetch(light_indices, int(cell.x + i)).r);
+        vec4 pos_range = texelFetch(light_data, light * 2);
+        vec3 light_col = texelFetch(light_data, light * 2 + 1).rgb;
+        vec3 direction = pos_range.xyz - frag_pos;
+
+        // Fade out smoothly towards the edge of the light's range
+        float falloff = length(direction) / pos_range.w;
+        falloff = clamp(1.0 - falloff * falloff * falloff * falloff, 0.0, 1.0);
+
+        result += calculate_light(direction, light_col, normal, frag_pos, colour)
+                * falloff * falloff;
+    }
+
+    return result;
+}
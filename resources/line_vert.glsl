@@ -1,10 +1,8 @@
-#version 330 core
 layout (location = 0) in vec3 a_pos;
 
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec3 origin;    // Tracers are relative to this
 
 void main() 
 {
-    gl_Position = projection * view * vec4(a_pos, 1.0);
+    gl_Position = projection * view * vec4(a_pos + origin, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#version 330 core
+
+// One vertex per body, run with rasterisation disabled. Integrates one
+// Euler step of the trajectory preview the same way as update_forces in
+// simulation.cpp, and captures the result with transform feedback.
+uniform samplerBuffer positions;    // xyz, w = mass
+uniform samplerBuffer velocities;   // xyz
+uniform int           num_bodies;
+uniform float         grav_constant;
+uniform float         time_step;
+
+out vec4 tf_position;
+out vec4 tf_velocity;
+
+const float epsilon = 0.0001;
+
+void main()
+{
+    vec4 body     = texelFetch(positions, gl_VertexID);
+    vec3 velocity = texelFetch(velocities, gl_VertexID).xyz;
+
+    for (int j = 0; j < num_bodies; ++j) {
+        vec4  other  = texelFetch(positions, j);
+        vec3  delta  = other.xyz - body.xyz;
+        float radius = length(delta);
+
+        // a = Gm/r^2 towards the other body
+        if (j != gl_VertexID && radius > epsilon) {
+            velocity += delta * (grav_constant * other.w * time_step / (radius * radius * radius));
+        }
+    }
+
+    tf_position = vec4(body.xyz + velocity * time_step, body.w);
+    tf_velocity = vec4(velocity, 0.0);
+}
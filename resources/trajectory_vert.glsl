@@ -0,0 +1,25 @@
+// Draws every body's trajectory in one instanced draw: the vertex is
+// the point along the trajectory and the instance is the body. Points
+// are stored a step at a time, so a step's points are contiguous.
+uniform samplerBuffer trajectory;
+uniform int           num_bodies;
+uniform int           relative_body;      // -1 if not drawing relative
+uniform vec3          relative_origin;    // Relative body's start position
+
+void main() 
+{
+    // Drawing relative to a body, its own trajectory is just a point
+    if (gl_InstanceID == relative_body) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);     // Clipped
+        return;
+    }
+
+    int  base = gl_VertexID * num_bodies;
+    vec3 pos  = texelFetch(trajectory, base + gl_InstanceID).xyz;
+
+    if (relative_body >= 0) {
+        pos -= texelFetch(trajectory, base + relative_body).xyz - relative_origin;
+    }
+
+    gl_Position = projection * view * vec4(pos, 1.0);
+}
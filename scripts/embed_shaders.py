@@ -0,0 +1,26 @@
+#!/usr/bin/env python3
+''' embed_shaders.py
+    Write every GLSL file in resources as an entry of a c++ 
+    array, so that a build with GRAVSIM_EMBED_SHADERS reads
+    its shaders from the executable instead of the working
+    directory. Each entry is the path the shader is loaded
+    by, and its source as a raw string literal.
+'''
+from glob import glob
+from os import path, pardir, makedirs
+
+SOURCES   = "resources/*.glsl"
+TARGET    = "binaries/embedded_shaders.inc"
+DELIMITER = "GLSL_SOURCE"
+DIR       = path.dirname(__file__)
+ROOT      = path.abspath(path.join(DIR, pardir))
+
+entries = []
+for file in sorted(glob(path.join(ROOT, SOURCES))):
+    name   = path.relpath(file, ROOT).replace(path.sep, "/")
+    source = open(file).read()
+    assert ")" + DELIMITER + '"' not in source, name + " contains the delimiter"
+    entries.append('{ "%s", R"%s(%s)%s" }' % (name, DELIMITER, source, DELIMITER))
+
+makedirs(path.dirname(path.join(ROOT, TARGET)), exist_ok=True)
+open(path.join(ROOT, TARGET), "w").write(",\n".join(entries) + "\n")
@@ -1,70 +1,97 @@
 #!/usr/bin/env python3
 ''' sphere_generator.py
-    Generate vertices and surface normals for a sphere
-    with a specified level of detail (cube sphere).
+    Generate indexed cube sphere meshes at several levels of 
+    detail, for drawing bodies at different sizes on screen.
     Outputs values separated by commas which can be embedded
-    in a c++ source file.
+    in a c++ source file: every level's vertices in one list,
+    every level's indices in another, and a row per level 
+    giving its first index, index count and base vertex.
 '''
 from math import sqrt
 from os import path, pardir
 
-LEVEL_OF_DETAIL = 8
-TARGET          = "/resources/spheremesh.txt"
-DIR             = path.dirname(__file__)
-OUTPUT_FILE     = path.abspath(path.join(DIR, pardir)) + TARGET
+LEVELS_OF_DETAIL = [16, 8, 4, 2]   # Grid size per cube face, most detailed first
+TARGET_VERTICES  = "/resources/spheremesh_vertices.txt"
+TARGET_INDICES   = "/resources/spheremesh_indices.txt"
+TARGET_LODS      = "/resources/spheremesh_lods.txt"
+DIR              = path.dirname(__file__)
+ROOT             = path.abspath(path.join(DIR, pardir))
 
 def normalise(vec):
     x, y, z = vec
     mag = sqrt(x*x + y*y + z*z)
     return x/mag, y/mag, z/mag
 
-def sub(a, b):
-    return tuple(
-        ac - bc
-        for ac, bc in zip(a, b)
-    )
-
-# Create a n*n grid of points where n is the level of detail
-grid_vertices = [
-    [
-        ((x * 2) / LEVEL_OF_DETAIL - 1, 
-         (y * 2) / LEVEL_OF_DETAIL - 1)
-        for x in range(LEVEL_OF_DETAIL+1)
+def sphere_mesh(level_of_detail):
+    # Create a n*n grid of points where n is the level of detail
+    grid_vertices = [
+        [
+            ((x * 2) / level_of_detail - 1, 
+             (y * 2) / level_of_detail - 1)
+            for x in range(level_of_detail+1)
+        ]
+        for y in range(level_of_detail+1)
     ]
-    for y in range(LEVEL_OF_DETAIL+1)
-]
 
-# Triangulate the grid into a mesh
-triangulated = sum([
-    [
-        grid_vertices[x  ][y  ],
-        grid_vertices[x  ][y+1],
-        grid_vertices[x+1][y+1],
-        grid_vertices[x+1][y+1],
-        grid_vertices[x+1][y  ],
-        grid_vertices[x  ][y  ],
+    # Triangulate the grid into a mesh
+    triangulated = sum([
+        [
+            grid_vertices[x  ][y  ],
+            grid_vertices[x  ][y+1],
+            grid_vertices[x+1][y+1],
+            grid_vertices[x+1][y+1],
+            grid_vertices[x+1][y  ],
+            grid_vertices[x  ][y  ],
+        ]
+        for x in range(level_of_detail)
+        for y in range(level_of_detail)
+    ], [])
+
+    # Join 6 copies of the mesh to form a cube
+    cube_mesh = [
+        *[(-1.0, y,   z  ) for y, z in triangulated[::-1]],
+        *[( 1.0, y,   z  ) for y, z in triangulated],
+        *[( x,  -1.0, z  ) for x, z in triangulated],
+        *[( x,   1.0, z  ) for x, z in triangulated[::-1]],
+        *[( x,   y,  -1.0) for x, y in triangulated[::-1]],
+        *[( x,   y,   1.0) for x, y in triangulated]
     ]
-    for x in range(LEVEL_OF_DETAIL)
-    for y in range(LEVEL_OF_DETAIL)
-], [])
 
-# Join 6 copies of the mesh to form a cube
-cube_mesh = [
-    *[(-1.0, y,   z  ) for y, z in triangulated[::-1]],
-    *[( 1.0, y,   z  ) for y, z in triangulated],
-    *[( x,  -1.0, z  ) for x, z in triangulated],
-    *[( x,   1.0, z  ) for x, z in triangulated[::-1]],
-    *[( x,   y,  -1.0) for x, y in triangulated[::-1]],
-    *[( x,   y,   1.0) for x, y in triangulated]
-]
+    # Normalise each vertex onto the sphere, merging the duplicates 
+    # where triangles (and cube faces) meet into one indexed vertex
+    vertices = []
+    indices  = []
+    lookup   = {}
+    for corner in cube_mesh:
+        key = tuple(round(c, 6) for c in corner)
+        if key not in lookup:
+            lookup[key] = len(vertices)
+            vertices.append(normalise(corner))
+        indices.append(lookup[key])
+
+    return vertices, indices
+
+all_vertices = []
+all_indices  = []
+lods         = []
+
+for level in LEVELS_OF_DETAIL:
+    vertices, indices = sphere_mesh(level)
+    lods.append((len(all_indices), len(indices), len(all_vertices)))
+    all_vertices += vertices
+    all_indices  += indices
+
+assert len(all_vertices) <= 65536, "indices must fit in an unsigned short"
 
-# Normalise each vertex in the cube mesh, then flatten into a 
-# 1D array.
-sphere_mesh_vertices = sum(
-    [list(normalise(i)) for i in cube_mesh],
-    []
-)
+def write(target, contents):
+    open(ROOT + target, "w").write(contents)
 
-as_str = [str(i) + "f" for i in sphere_mesh_vertices]
-new_contents = ",\n".join(as_str)
-open(OUTPUT_FILE, "w").write(new_contents)
\ No newline at end of file
+write(TARGET_VERTICES, ",\n".join(
+    str(c) + "f" for vertex in all_vertices for c in vertex
+))
+write(TARGET_INDICES, ",\n".join(
+    str(i) for i in all_indices
+))
+write(TARGET_LODS, ",\n".join(
+    "MeshRange{ %d, %d, %d }" % lod for lod in lods
+))
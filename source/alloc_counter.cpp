@@ -0,0 +1,158 @@
+#include "alloc_counter.h"
+
+#ifdef GRAVSIM_COUNT_ALLOCATIONS
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> allocations = 0;
+
+static void* counted_alloc(size_t size)
+{
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+static void* counted_alloc(size_t size, std::align_val_t align)
+{
+    // aligned_alloc needs the size to be a multiple of the alignment
+    ++allocations;
+    size_t alignment = static_cast<size_t>(align);
+    size_t rounded   = (std::max<size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+    return std::aligned_alloc(alignment, rounded);
+}
+
+// Every replaceable form of the global operator new, so that nothing,
+// e.g. over-aligned types or nothrow callers, is missed. Memory comes
+// from malloc either way, so all of the deletes are free.
+void* operator new(size_t size)
+{
+    if (void *ptr = counted_alloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    if (void *ptr = counted_alloc(size, align)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, align);
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size, align);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+size_t allocation_count()
+{
+    return allocations;
+}
+
+bool counting_allocations()
+{
+    return true;
+}
+
+#else
+
+size_t allocation_count()
+{
+    return 0;
+}
+
+bool counting_allocations()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+
+// Number of heap allocations made by the program so far. Allocations
+// are only counted when built with GRAVSIM_COUNT_ALLOCATIONS defined
+// (see the benchmark target in the Makefile), otherwise this returns 0.
+size_t allocation_count();
+bool counting_allocations();
@@ -0,0 +1,33 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::string_view NameArena::intern(std::string_view name)
+{
+    size_t size = name.size() + 1;
+
+    // Start a new chunk when the current one is full. Oversized 
+    // names get a chunk of their own.
+    if (chunk_used + size > chunk_capacity) {
+        chunk_capacity = std::max(CHUNK_SIZE, size);
+        chunk_used     = 0;
+        chunks.push_back(std::make_unique<char[]>(chunk_capacity));
+    }
+
+    char *dest = chunks.back().get() + chunk_used;
+    std::memcpy(dest, name.data(), name.size());
+    dest[name.size()] = '\0';
+
+    chunk_used += size;
+    stored     += size;
+    return std::string_view(dest, name.size());
+}
+
+void NameArena::clear()
+{
+    chunks.clear();
+    chunk_used     = 0;
+    chunk_capacity = 0;
+    stored         = 0;
+}
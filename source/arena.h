@@ -0,0 +1,23 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <cstddef>
+
+// Append-only storage for body names. Names are copied into large 
+// chunks which never move, so the returned views stay valid until 
+// clear(). Every stored name is null terminated, so view.data() can be
+// passed straight to C string APIs such as ImGui.
+class NameArena {
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_used     = 0;
+    size_t chunk_capacity = 0;
+    size_t stored         = 0;
+
+public:
+    std::string_view intern(std::string_view name);
+    void clear();
+    size_t size() const { return stored; }
+};
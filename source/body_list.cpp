@@ -0,0 +1,199 @@
+#include "body_list.h"
+
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+
+static void fold_into(std::string& dest, std::string_view text)
+{
+    for (char c : text) {
+        dest += std::tolower(static_cast<unsigned char>(c));
+    }
+}
+
+void BodyList::refresh(const Simulation& simulation, glm::vec3 origin)
+{
+    bool rebuilt = false;
+    if (simulation.body_version != indexed_version) {
+        build_index(simulation);
+        rebuilt = true;
+    }
+
+    if (rebuilt || filter != applied_filter || use_regex != applied_regex) {
+        apply_filter(rebuilt);
+    }
+
+    if (searching()) {
+        if (applied_regex) {
+            scan_regex();
+        } else {
+            scan_substring();
+        }
+    }
+
+    bool key_changed = sort_key != applied_key
+                    || descending != applied_descending;
+    if (!searching() && (!sorted || key_changed)) {
+        sort(simulation, origin);
+    }
+}
+
+void BodyList::resort()
+{
+    sorted = false;
+}
+
+void BodyList::build_index(const Simulation& simulation)
+{
+    folded_names.clear();
+    name_offsets.clear();
+    name_offsets.reserve(simulation.num_bodies + 1);
+
+    for (int i = 0; i < simulation.num_bodies; ++i) {
+        name_offsets.push_back(folded_names.size());
+        fold_into(folded_names, simulation.get_info(i).name);
+        folded_names += '\0';
+    }
+    name_offsets.push_back(folded_names.size());
+
+    indexed_version = simulation.body_version;
+    indexed_bodies  = simulation.num_bodies;
+}
+
+void BodyList::apply_filter(bool rebuilt)
+{
+    // Typing more characters of a plain filter can only remove
+    // matches, so narrow the previous results instead of rescanning.
+    // Removing rows keeps the existing order, so no re-sort is needed.
+    bool narrowing = !rebuilt && !use_regex && !applied_regex
+                  && !searching() && filter.starts_with(applied_filter);
+
+    applied_filter = filter;
+    applied_regex  = use_regex;
+    folded_filter.clear();
+    fold_into(folded_filter, filter);
+
+    if (narrowing) {
+        std::erase_if(matches, [&](int i) {
+            return folded_name(i).find(folded_filter) == std::string_view::npos;
+        });
+        return;
+    }
+
+    matches.clear();
+    scanned = 0;
+    sorted  = false;
+    invalid_pattern = false;
+
+    if (use_regex && !filter.empty()) {
+        try {
+            // Compiled from the text as typed, as lowercasing would
+            // turn escapes like \D into their opposites. icase lets
+            // it match the folded names.
+            pattern = std::regex(filter, std::regex::icase);
+        } catch (const std::regex_error&) {
+            // Show nothing until the pattern is valid again
+            invalid_pattern = true;
+            scanned = indexed_bodies;
+        }
+    }
+}
+
+void BodyList::scan_substring()
+{
+    if (folded_filter.empty()) {
+        matches.resize(indexed_bodies);
+        std::iota(matches.begin(), matches.end(), 0);
+        scanned = indexed_bodies;
+        return;
+    }
+
+    // Search the whole name buffer, mapping each hit back
+    // to its body and skipping the rest of that name
+    std::string_view names = folded_names;
+    size_t from = 0;
+
+    while ((from = names.find(folded_filter, from)) != std::string_view::npos) {
+        auto next = std::upper_bound(
+            name_offsets.begin(), name_offsets.end(), from);
+        int body = next - name_offsets.begin() - 1;
+        matches.push_back(body);
+        from = *next;
+    }
+
+    scanned = indexed_bodies;
+}
+
+void BodyList::scan_regex()
+{
+    // Regular expressions are slow, so only match a slice of the
+    // bodies each frame and let the results stream in
+    constexpr int BODIES_PER_FRAME = 50000;
+
+    if (applied_filter.empty()) {
+        scan_substring();
+        return;
+    }
+
+    int end = std::min(indexed_bodies, scanned + BODIES_PER_FRAME);
+    for (int i = scanned; i < end; ++i) {
+        auto name = folded_name(i);
+        if (std::regex_search(name.begin(), name.end(), pattern)) {
+            matches.push_back(i);
+        }
+    }
+
+    scanned = end;
+}
+
+void BodyList::sort(const Simulation& simulation, glm::vec3 origin)
+{
+    applied_key        = sort_key;
+    applied_descending = descending;
+    sorted             = true;
+
+    auto order = [&](auto&& less) {
+        if (descending) {
+            std::sort(matches.begin(), matches.end(),
+                      [&](int a, int b) { return less(b, a); });
+        } else {
+            std::sort(matches.begin(), matches.end(), less);
+        }
+    };
+
+    if (sort_key == BodySortKey::Index) {
+        order([](int a, int b) { return a < b; });
+        return;
+    }
+
+    if (sort_key == BodySortKey::Name) {
+        order([&](int a, int b) { return folded_name(a) < folded_name(b); });
+        return;
+    }
+
+    // Look up each key once rather than in every comparison
+    sort_values.resize(indexed_bodies);
+    for (int i : matches) {
+        const auto& physics = simulation.get_physics(i);
+        switch (sort_key) {
+        case BodySortKey::Mass:
+            sort_values[i] = physics.mass;
+            break;
+        case BodySortKey::Distance:
+            sort_values[i] = glm::length(physics.position - origin);
+            break;
+        default:
+            sort_values[i] = glm::length(physics.velocity);
+            break;
+        }
+    }
+
+    order([&](int a, int b) { return sort_values[a] < sort_values[b]; });
+}
+
+std::string_view BodyList::folded_name(int index) const
+{
+    size_t begin = name_offsets[index];
+    size_t end   = name_offsets[index + 1] - 1;
+    return std::string_view(folded_names).substr(begin, end - begin);
+}
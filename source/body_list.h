@@ -0,0 +1,67 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <glm/glm.hpp>
+
+#include <regex>
+#include <string>
+#include <vector>
+
+enum class BodySortKey {
+    Index, Name, Mass, Distance, Speed
+};
+
+constexpr const char *BODY_SORT_KEY_NAMES[] = {
+    "index", "name", "mass", "distance", "speed"
+};
+
+// Filtered and sorted view of the bodies for the body picker. Results
+// are cached between frames and only recomputed when the bodies or the
+// filter change, so an unchanged list costs nothing to show.
+class BodyList {
+public:
+    // Edited directly by the GUI
+    std::string filter;
+    bool use_regex = false;
+    BodySortKey sort_key = BodySortKey::Index;
+    bool descending = false;
+
+    // Bring the rows up to date. Distances are measured from origin.
+    void refresh(const Simulation& simulation, glm::vec3 origin);
+    // Re-sort on the next refresh, for keys that change as bodies move
+    void resort();
+
+    const std::vector<int>& rows() const { return matches; }
+    bool searching() const { return scanned < indexed_bodies; }
+    bool bad_pattern() const { return invalid_pattern; }
+
+private:
+    // Prebuilt index: every name lowercased and null separated in one
+    // buffer, so substring searches are a single pass over memory
+    std::string folded_names;
+    std::vector<uint32_t> name_offsets;
+    uint64_t indexed_version = UINT64_MAX;
+    int indexed_bodies = 0;
+
+    // State of the filter that produced the current matches
+    std::string applied_filter;
+    std::string folded_filter;
+    bool applied_regex = false;
+    bool invalid_pattern = false;
+    std::regex pattern;
+    std::vector<int> matches;
+    int scanned = 0;
+
+    bool sorted = false;
+    BodySortKey applied_key = BodySortKey::Index;
+    bool applied_descending = false;
+    std::vector<float> sort_values;
+
+    void build_index(const Simulation& simulation);
+    void apply_filter(bool rebuilt);
+    void scan_substring();
+    void scan_regex();
+    void sort(const Simulation& simulation, glm::vec3 origin);
+    std::string_view folded_name(int index) const;
+};
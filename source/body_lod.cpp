@@ -0,0 +1,29 @@
+#include "body_lod.h"
+#include "culling.h"
+
+void BodyLOD::build(const Simulation& simulation, 
+                    const glm::mat4& view, const glm::mat4& projection,
+                    float pixels_per_unit)
+{
+    for (auto& bucket : buckets) {
+        bucket.clear();
+    }
+
+    cull_bodies(simulation, frustum_planes(projection * view), visible);
+
+    for (int i : visible) {
+        const auto& physics = simulation.get_physics(i);
+        float depth = -(view * glm::vec4(physics.position, 1.0f)).z;
+
+        // Bodies around the camera get the most detailed mesh
+        int bucket = 0;
+        if (depth > physics.radius) {
+            float pixels = physics.radius / depth * pixels_per_unit;
+            while (bucket < NUM_MESHES && pixels < MIN_PIXELS[bucket]) {
+                ++bucket;
+            }
+        }
+
+        buckets[bucket].push_back(simulation.get_instance(i));
+    }
+}
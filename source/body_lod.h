@@ -0,0 +1,38 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+
+// Sorts the body instances into buckets by how big each body is on
+// screen: one bucket per sphere mesh, most detailed first, then a last
+// bucket for bodies too small for a mesh to be worth it, which are drawn
+// as ray cast impostors on a single quad. Bodies outside the view 
+// frustum are culled first and aren't in any bucket.
+class BodyLOD {
+public:
+    static constexpr int NUM_MESHES = 4;
+    static constexpr int IMPOSTORS  = NUM_MESHES;
+    static constexpr int NUM_BUCKETS = NUM_MESHES + 1;
+
+    // Smallest projected radius in pixels drawn with each mesh
+    static constexpr std::array<float, NUM_MESHES> MIN_PIXELS = {
+        48.0f, 12.0f, 5.0f, 2.5f
+    };
+
+    std::array<std::vector<BodyInstance>, NUM_BUCKETS> buckets;
+
+    // pixels_per_unit is the size in pixels of one unit at a distance
+    // of one unit from the camera
+    void build(const Simulation& simulation, 
+               const glm::mat4& view, const glm::mat4& projection,
+               float pixels_per_unit);
+
+    int num_visible() const { return visible.size(); }
+
+private:
+    std::vector<int> visible;
+};
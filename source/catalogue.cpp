@@ -0,0 +1,432 @@
+#include "catalogue.h"
+#include "parallel.h"
+#include "scene_generators.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Least text worth handing to a parsing task of its own
+constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+struct ParsedBody {
+    BodyPhysics physics;
+    std::string_view name;      // Into the text being parsed
+};
+
+// The bodies from one chunk of a block, in file order
+struct ParsedChunk {
+    std::vector<ParsedBody> bodies;
+    int skipped = 0;
+};
+
+// How much of the file has been parsed, reported to the caller
+struct ImportProgress {
+    size_t total = 0;                   // 0 if unknown, e.g. for stdin
+    std::atomic<size_t> parsed = 0;
+
+    void add(const CatalogueOptions& options, size_t bytes)
+    {
+        size_t done = parsed += bytes;
+        if (options.progress && total > 0) {
+            options.progress->store(std::min(1.0f, float(done) / total));
+        }
+    }
+};
+
+bool cancelled(const CatalogueOptions& options)
+{
+    return options.cancel && options.cancel->load(std::memory_order_relaxed);
+}
+
+// How to split a line, and which field is in each column
+struct ColumnLayout {
+    std::vector<int> field_of_column;   // Up to the last mapped column
+    int mapped = 0;
+    bool commas = false;
+};
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+std::string_view trim(std::string_view text)
+{
+    while (!text.empty() && is_space(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && is_space(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+bool parse_number(std::string_view text, float& value)
+{
+    // from_chars doesn't take a leading plus
+    if (!text.empty() && text.front() == '+') {
+        text.remove_prefix(1);
+    }
+    const char *end = text.data() + text.size();
+    auto [ptr, error] = std::from_chars(text.data(), end, value);
+    return error == std::errc() && ptr == end;
+}
+
+bool set_field(ParsedBody& body, CatalogueField field, std::string_view text,
+               const CatalogueOptions& options)
+{
+    auto& physics = body.physics;
+    if (field == CatalogueField::Name) {
+        if (text.size() >= 2 && text.front() == '"' && text.back() == '"') {
+            text = text.substr(1, text.size() - 2);
+        }
+        body.name = text;
+        return true;
+    }
+
+    float value;
+    if (!parse_number(text, value)) {
+        return false;
+    }
+    switch (field) {
+    case CatalogueField::X:      physics.position.x = value * options.length_scale;   break;
+    case CatalogueField::Y:      physics.position.y = value * options.length_scale;   break;
+    case CatalogueField::Z:      physics.position.z = value * options.length_scale;   break;
+    case CatalogueField::VX:     physics.velocity.x = value * options.velocity_scale; break;
+    case CatalogueField::VY:     physics.velocity.y = value * options.velocity_scale; break;
+    case CatalogueField::VZ:     physics.velocity.z = value * options.velocity_scale; break;
+    case CatalogueField::Mass:   physics.mass       = value * options.mass_scale;     break;
+    case CatalogueField::Radius: physics.radius     = value * options.length_scale;   break;
+    case CatalogueField::Name:   break;
+    }
+    return true;
+}
+
+// Fills in body from one line, returning false if it isn't a body
+bool parse_line(std::string_view line, const ColumnLayout& layout,
+                const CatalogueOptions& options, ParsedBody& body)
+{
+    body = ParsedBody();
+    int last_column = layout.field_of_column.size();
+    int found = 0;
+    size_t pos = 0;
+    bool more = true;
+
+    for (int column = 0; column < last_column && more; ++column) {
+        std::string_view text;
+        if (layout.commas) {
+            size_t end = line.find(',', pos);
+            if (end == std::string_view::npos) {
+                end  = line.size();
+                more = false;
+            }
+            text = trim(line.substr(pos, end - pos));
+            pos  = end + 1;
+        } else {
+            while (pos < line.size() && is_space(line[pos])) {
+                ++pos;
+            }
+            size_t end = pos;
+            while (end < line.size() && !is_space(line[end])) {
+                ++end;
+            }
+            text = line.substr(pos, end - pos);
+            pos  = end;
+            more = pos < line.size();
+        }
+
+        int field = layout.field_of_column[column];
+        if (field >= 0) {
+            if (!set_field(body, CatalogueField(field), text, options)) {
+                return false;
+            }
+            ++found;
+        }
+    }
+
+    body.physics.orig_position = body.physics.position;
+    body.physics.orig_velocity = body.physics.velocity;
+    return found == layout.mapped;
+}
+
+void parse_chunk(std::string_view text, const ColumnLayout& layout,
+                 const CatalogueOptions& options, ParsedChunk& chunk)
+{
+    ParsedBody body;
+    while (!text.empty() && !cancelled(options)) {
+        size_t end = text.find('\n');
+        auto line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        auto trimmed = trim(line);
+        if (trimmed.empty() || trimmed.front() == '#') {
+            continue;
+        }
+        if (parse_line(line, layout, options, body)) {
+            chunk.bodies.push_back(body);
+        } else {
+            ++chunk.skipped;
+        }
+    }
+}
+
+// Chooses commas or whitespace from the first line that isn't blank or
+// a comment. Returns false if there isn't one yet.
+bool detect_separator(std::string_view text, ColumnLayout& layout)
+{
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        auto line = trim(text.substr(0, end));
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (!line.empty() && line.front() != '#') {
+            layout.commas = line.find(',') != std::string_view::npos;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parses whole lines of text in parallel and appends the bodies
+void import_block(Simulation& simulation, std::string_view text,
+                  const ColumnLayout& layout, const CatalogueOptions& options,
+                  ImportProgress& progress, CatalogueResult& result)
+{
+    int hardware   = std::max(1u, std::thread::hardware_concurrency());
+    int num_chunks = std::clamp<size_t>(text.size() / MIN_CHUNK_SIZE, 1, hardware * 4);
+
+    // Chunks end just after a newline, so no line is split
+    std::vector<size_t> bounds(num_chunks + 1, text.size());
+    bounds[0] = 0;
+    for (int c = 1; c < num_chunks; ++c) {
+        size_t target = std::max(text.size() * c / num_chunks, bounds[c - 1]);
+        size_t newline = text.find('\n', target);
+        bounds[c] = newline == std::string_view::npos ? text.size() : newline + 1;
+    }
+
+    std::vector<ParsedChunk> chunks(num_chunks);
+    parallel_for(num_chunks, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            auto chunk_text = text.substr(bounds[c], bounds[c + 1] - bounds[c]);
+            parse_chunk(chunk_text, layout, options, chunks[c]);
+            progress.add(options, chunk_text.size());
+        }
+    }, 1);
+    if (cancelled(options)) {
+        return;
+    }
+
+    std::vector<int> offsets(num_chunks);
+    int count = 0;
+    for (int c = 0; c < num_chunks; ++c) {
+        offsets[c] = count;
+        count += chunks[c].bodies.size();
+        result.skipped += chunks[c].skipped;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    int first = simulation.append_bodies(count);
+    parallel_for(num_chunks, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            int index = first + offsets[c];
+            for (const auto& body : chunks[c].bodies) {
+                simulation.body_physics[index] = body.physics;
+                auto& instance = simulation.body_instance[index];
+                instance.model       = glm::mat4(1.0f);
+                instance.colour      = glm::vec3(1.0f, 0.5f, 0.31f);
+                instance.emits_light = 0;
+                ++index;
+            }
+        }
+    }, 1);
+
+    // Names are interned on one thread, as the arena isn't shared
+    if (options.columns[int(CatalogueField::Name)] >= 0) {
+        int index = first;
+        for (const auto& chunk : chunks) {
+            for (const auto& body : chunk.bodies) {
+                simulation.set_name(index++, body.name);
+            }
+        }
+    } else {
+        int number = options.first_index < 0 ? -1 : options.first_index + first;
+        name_bodies(simulation, first, count, "Body ", number);
+    }
+    result.imported += count;
+}
+
+CatalogueResult import_mapped(Simulation& simulation, const CatalogueOptions& options,
+                              ColumnLayout& layout)
+{
+    CatalogueResult result;
+    int fd = open(options.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return result;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return result;
+    }
+    size_t size = info.st_size;
+    if (size == 0) {
+        close(fd);
+        result.ok = true;
+        return result;
+    }
+
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return result;
+    }
+    // Every thread reads its own part, so fault the pages in early
+    madvise(data, size, MADV_WILLNEED);
+
+    std::string_view text(static_cast<const char*>(data), size);
+    detect_separator(text, layout);
+    ImportProgress progress;
+    progress.total = size;
+    import_block(simulation, text, layout, options, progress, result);
+    munmap(data, size);
+    result.ok = !cancelled(options);
+    return result;
+}
+
+CatalogueResult import_streamed(Simulation& simulation, const CatalogueOptions& options,
+                                ColumnLayout& layout)
+{
+    CatalogueResult result;
+    bool from_stdin = options.path == "-";
+    int fd = from_stdin ? STDIN_FILENO : open(options.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return result;
+    }
+
+    ImportProgress progress;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        progress.total = info.st_size;
+    }
+
+    std::vector<char> buffer(std::max<size_t>(options.block_size, 4096));
+    size_t filled = 0;
+    bool detected = false;
+    bool finished = false;
+
+    while (!finished && !cancelled(options)) {
+        ssize_t count = read(fd, buffer.data() + filled, buffer.size() - filled);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        filled  += count;
+        finished = count == 0;
+
+        // Parse up to the last complete line, and keep the rest for the
+        // next block. The end of the file completes the last line.
+        size_t end = filled;
+        if (!finished) {
+            auto newline = std::string_view(buffer.data(), filled).rfind('\n');
+            if (newline == std::string_view::npos) {
+                // A line longer than the buffer
+                if (filled == buffer.size()) {
+                    buffer.resize(buffer.size() * 2);
+                }
+                continue;
+            }
+            end = newline + 1;
+        }
+
+        std::string_view text(buffer.data(), end);
+        if (!detected) {
+            detected = detect_separator(text, layout);
+        }
+        import_block(simulation, text, layout, options, progress, result);
+
+        std::memmove(buffer.data(), buffer.data() + end, filled - end);
+        filled -= end;
+    }
+
+    if (!from_stdin) {
+        close(fd);
+    }
+    result.ok = finished && !cancelled(options);
+    return result;
+}
+
+}
+
+CatalogueResult import_catalogue(Simulation& simulation, const CatalogueOptions& options)
+{
+    ColumnLayout layout;
+    for (int field = 0; field < NUM_CATALOGUE_FIELDS; ++field) {
+        int column = options.columns[field];
+        if (column < 0) {
+            continue;
+        }
+        if (column >= int(layout.field_of_column.size())) {
+            layout.field_of_column.resize(column + 1, -1);
+        }
+        layout.field_of_column[column] = field;
+    }
+    layout.mapped = std::count_if(
+        layout.field_of_column.begin(), layout.field_of_column.end(),
+        [](int field) { return field >= 0; });
+
+    // Standard input can only be read as it arrives
+    if (options.streaming || options.path == "-") {
+        return import_streamed(simulation, options, layout);
+    }
+    return import_mapped(simulation, options, layout);
+}
+
+bool parse_catalogue_columns(const char *spec, CatalogueOptions& options)
+{
+    int columns[NUM_CATALOGUE_FIELDS];
+    std::fill(std::begin(columns), std::end(columns), -1);
+
+    std::string_view text(spec);
+    while (!text.empty()) {
+        size_t end = text.find(',');
+        auto entry = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+        size_t equals = entry.find('=');
+        if (equals == std::string_view::npos) {
+            return false;
+        }
+        auto name  = entry.substr(0, equals);
+        auto value = entry.substr(equals + 1);
+
+        auto *names_end = std::end(CATALOGUE_FIELD_NAMES);
+        auto *found = std::find(std::begin(CATALOGUE_FIELD_NAMES), names_end, name);
+        int column;
+        auto [ptr, error] = std::from_chars(value.data(), value.data() + value.size(), column);
+        if (found == names_end || error != std::errc()
+            || ptr != value.data() + value.size() || column < 0) {
+            return false;
+        }
+        columns[found - std::begin(CATALOGUE_FIELD_NAMES)] = column;
+    }
+
+    std::copy(std::begin(columns), std::end(columns), options.columns);
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <string>
+
+// Imports bodies from text catalogues written by other codes, e.g.
+//   prog --headless --import stars.csv --columns x=1,y=2,z=3,mass=7
+// One body per line, with the fields separated by commas or, if the
+// first line has no commas, by whitespace. Blank lines and lines
+// starting with # are ignored. Lines where a mapped column is missing
+// or isn't a number, such as a header, are skipped.
+
+enum class CatalogueField {
+    X, Y, Z, VX, VY, VZ, Mass, Radius, Name
+};
+
+constexpr const char *CATALOGUE_FIELD_NAMES[] = {
+    "x", "y", "z", "vx", "vy", "vz", "mass", "radius", "name"
+};
+
+constexpr int NUM_CATALOGUE_FIELDS = std::size(CATALOGUE_FIELD_NAMES);
+
+struct CatalogueOptions {
+    std::string path;               // - for standard input
+    // The column of each field, counting from 0, or -1 if it isn't in
+    // the file. Missing fields keep BodyPhysics' defaults.
+    int columns[NUM_CATALOGUE_FIELDS] = { 0, 1, 2, 3, 4, 5, 6, -1, -1 };
+    // Multiply the values into the simulation's units. The length
+    // scale applies to the positions and radii.
+    float length_scale   = 1.0f;
+    float velocity_scale = 1.0f;
+    float mass_scale     = 1.0f;
+    // Read the file a block at a time, rather than mapping all of it,
+    // so the text never takes more than block_size of memory at once
+    bool streaming = false;
+    size_t block_size = 64 << 20;
+    // For imports on another thread. Setting cancel stops the import
+    // early, returning ok as false, and progress goes from 0 to 1 if
+    // the file's size is known.
+    const std::atomic<bool> *cancel = nullptr;
+    std::atomic<float> *progress = nullptr;
+    // Bodies without a name column are called "Body <index>". When
+    // importing into a scene of its own to be added to another later,
+    // this is the index they will start from there.
+    int first_index = -1;
+};
+
+struct CatalogueResult {
+    bool ok = false;                // False if the file couldn't be read
+    int imported = 0;
+    int skipped = 0;                // Lines that weren't bodies
+};
+
+// Appends the catalogue's bodies to the simulation. Blocks of the file
+// are split into chunks on line boundaries and parsed in parallel.
+CatalogueResult import_catalogue(Simulation& simulation, const CatalogueOptions& options);
+
+// Parses a column mapping like "x=0,y=1,z=2,mass=6". Fields that
+// aren't mentioned are missing from the file.
+bool parse_catalogue_columns(const char *spec, CatalogueOptions& options);
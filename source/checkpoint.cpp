@@ -0,0 +1,146 @@
+#include "checkpoint.h"
+#include "file_util.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Identifies a checkpoint, followed by the format version
+static constexpr char CHECKPOINT_MAGIC[] = { 'G', 'S', 'C', 'K' };
+static constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+// Everything besides the bodies that the next step depends on
+struct CheckpointHeader {
+    uint32_t version;
+    int64_t step;
+    int num_updates;
+    SimulationState state;
+};
+
+std::streamsize Checkpointer::AppendBuffer::xsputn(const char *bytes, std::streamsize count)
+{
+    data.append(bytes, count);
+    return count;
+}
+
+Checkpointer::AppendBuffer::int_type Checkpointer::AppendBuffer::overflow(int_type c)
+{
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        data.push_back(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+}
+
+Checkpointer::Checkpointer(const std::string& path)
+    : path(path), temp_path(path + ".tmp"), directory(directory_of(path)),
+      snapshot_stream(&snapshot)
+{
+    writer = std::thread([this] { write_loop(); });
+}
+
+Checkpointer::~Checkpointer()
+{
+    {
+        std::lock_guard lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    writer.join();
+}
+
+void Checkpointer::reserve(const Simulation& simulation)
+{
+    // Serialise once to find the size, then grow the other two
+    write_snapshot_buffer(simulation, 0);
+    size_t size = snapshot.data.size();
+
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [this] { return !has_pending && !writing; });
+    pending.reserve(size);
+    writing_data.reserve(size);
+}
+
+void Checkpointer::save(const Simulation& simulation, int64_t step)
+{
+    // The copy is the only part done on the simulation's thread
+    write_snapshot_buffer(simulation, step);
+    {
+        std::lock_guard lock(mutex);
+        pending.swap(snapshot.data);
+        has_pending = true;
+    }
+    changed.notify_all();
+}
+
+void Checkpointer::write_snapshot_buffer(const Simulation& simulation, int64_t step)
+{
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.version     = CHECKPOINT_VERSION;
+    header.step        = step;
+    header.num_updates = simulation.num_updates;
+    header.state       = simulation.state;
+
+    snapshot.data.clear();
+    snapshot_stream.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    snapshot_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    simulation.write_simulation(snapshot_stream);
+}
+
+void Checkpointer::flush()
+{
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [this] { return !has_pending && !writing; });
+}
+
+bool Checkpointer::ok()
+{
+    std::lock_guard lock(mutex);
+    return !failed;
+}
+
+void Checkpointer::write_loop()
+{
+    std::unique_lock lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return has_pending || closing; });
+        if (!has_pending) {
+            return;
+        }
+        writing_data.swap(pending);
+        has_pending = false;
+        writing = true;
+
+        lock.unlock();
+        bool written = replace_file(path.c_str(), temp_path.c_str(), directory.c_str(),
+                                    writing_data, nullptr, nullptr);
+        if (!written) {
+            std::cerr << "Failed to write checkpoint " << path << "\n";
+        }
+        lock.lock();
+
+        failed = failed || !written;
+        writing = false;
+        changed.notify_all();
+    }
+}
+
+int64_t load_checkpoint(const std::string& path, Simulation& simulation)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    if (!file.read(magic, sizeof(magic))
+        || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+        return -1;
+    }
+
+    CheckpointHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || header.version != CHECKPOINT_VERSION
+        || !simulation.read_simulation(file)) {
+        return -1;
+    }
+    simulation.num_updates = header.num_updates;
+    simulation.state = header.state;
+    return header.step;
+}
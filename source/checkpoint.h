@@ -0,0 +1,71 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+// Periodic checkpoints of a long headless run, so that it can be picked
+// up again after a crash with --resume. The simulation is copied into a
+// buffer between steps, and written out on a background thread so the
+// run only pauses for the copy. A checkpoint holds everything a step
+// depends on, so a resumed run matches one that was never interrupted.
+class Checkpointer {
+public:
+    explicit Checkpointer(const std::string& path);
+    // Waits for the last checkpoint to be written
+    ~Checkpointer();
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // Sizes the buffers for checkpoints of the simulation, so that a
+    // run whose bodies don't change in number doesn't allocate later
+    void reserve(const Simulation& simulation);
+    // Snapshots the simulation after the given step. If the previous
+    // checkpoint is still being written, this one replaces any other
+    // waiting behind it, as only the latest is worth keeping.
+    void save(const Simulation& simulation, int64_t step);
+    // Waits until every snapshot taken so far is on disk
+    void flush();
+    // Whether every checkpoint so far has been written successfully
+    bool ok();
+
+private:
+    // Appends to a string, keeping its capacity between checkpoints
+    class AppendBuffer : public std::streambuf {
+    public:
+        std::string data;
+    protected:
+        std::streamsize xsputn(const char *bytes, std::streamsize count) override;
+        int_type overflow(int_type c) override;
+    };
+
+    std::string path;
+    std::string temp_path;
+    std::string directory;
+    // The three buffers are swapped around rather than copied, so
+    // they all keep the capacity of a whole checkpoint
+    AppendBuffer snapshot;      // Only used by the simulation's thread
+    std::ostream snapshot_stream;
+    std::string writing_data;   // Only used by the writer thread
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::string pending;        // Latest snapshot, waiting to be written
+    bool has_pending = false;
+    bool writing  = false;
+    bool closing  = false;
+    bool failed   = false;
+    std::thread writer;
+
+    void write_snapshot_buffer(const Simulation& simulation, int64_t step);
+    void write_loop();
+};
+
+// Loads a checkpoint into the simulation. Returns the number of steps
+// the run had completed, or -1 if the file is missing or damaged.
+int64_t load_checkpoint(const std::string& path, Simulation& simulation);
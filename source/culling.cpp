@@ -0,0 +1,101 @@
+#include "culling.h"
+
+#include <bit>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+std::array<glm::vec4, 6> frustum_planes(const glm::mat4& view_projection)
+{
+    // A clip space point is inside when -w <= x, y, z <= w, which 
+    // gives each plane as a sum of rows of the matrix. Rows are 
+    // read across glm's columns.
+    auto row = [&](int i) {
+        return glm::vec4(
+            view_projection[0][i], view_projection[1][i], 
+            view_projection[2][i], view_projection[3][i]);
+    };
+
+    std::array<glm::vec4, 6> planes = {
+        row(3) + row(0), row(3) - row(0),
+        row(3) + row(1), row(3) - row(1),
+        row(3) + row(2), row(3) - row(2)
+    };
+
+    for (auto& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    return planes;
+}
+
+void cull_bodies(const Simulation& simulation, 
+                 const std::array<glm::vec4, 6>& planes,
+                 std::vector<int>& visible)
+{
+    visible.clear();
+    int i = 0;
+
+#if defined(__SSE__)
+    __m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+    for (int p = 0; p < 6; ++p) {
+        plane_x[p] = _mm_set1_ps(planes[p].x);
+        plane_y[p] = _mm_set1_ps(planes[p].y);
+        plane_z[p] = _mm_set1_ps(planes[p].z);
+        plane_w[p] = _mm_set1_ps(planes[p].w);
+    }
+
+    for (; i + 4 <= simulation.num_bodies; i += 4) {
+        const auto& a = simulation.get_physics(i);
+        const auto& b = simulation.get_physics(i + 1);
+        const auto& c = simulation.get_physics(i + 2);
+        const auto& d = simulation.get_physics(i + 3);
+
+        // Lanes are given highest first, so lane n holds body i + n
+        __m128 x = _mm_set_ps(d.position.x, c.position.x, b.position.x, a.position.x);
+        __m128 y = _mm_set_ps(d.position.y, c.position.y, b.position.y, a.position.y);
+        __m128 z = _mm_set_ps(d.position.z, c.position.z, b.position.z, a.position.z);
+        __m128 neg_radius = _mm_set_ps(-d.radius, -c.radius, -b.radius, -a.radius);
+
+        // A sphere is outside if its centre is further than 
+        // its radius behind any one of the planes
+        __m128 inside = _mm_cmpge_ps(
+            _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, plane_x[0]), _mm_mul_ps(y, plane_y[0])),
+                _mm_add_ps(_mm_mul_ps(z, plane_z[0]), plane_w[0])),
+            neg_radius);
+
+        for (int p = 1; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, plane_x[p]), _mm_mul_ps(y, plane_y[p])),
+                _mm_add_ps(_mm_mul_ps(z, plane_z[p]), plane_w[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_radius));
+        }
+
+        unsigned mask = _mm_movemask_ps(inside);
+        while (mask != 0) {
+            visible.push_back(i + std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // The remainder, or everything without SSE
+    for (; i < simulation.num_bodies; ++i) {
+        const auto& physics = simulation.get_physics(i);
+        bool inside = true;
+
+        for (const auto& plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), physics.position) + plane.w;
+            if (distance < -physics.radius) {
+                inside = false;
+                break;
+            }
+        }
+
+        if (inside) {
+            visible.push_back(i);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+
+// Planes of the view frustum, normalised so that for a point p 
+// dot(plane.xyz, p) + plane.w is its distance inside the plane
+std::array<glm::vec4, 6> frustum_planes(const glm::mat4& view_projection);
+
+// Indices of the bodies whose spheres are at least partly inside the
+// frustum, in index order. Tests four bodies at a time with SSE when
+// it's available.
+void cull_bodies(const Simulation& simulation, 
+                 const std::array<glm::vec4, 6>& planes,
+                 std::vector<int>& visible);
@@ -0,0 +1,456 @@
+#include "distributed.h"
+
+#include <iostream>
+
+#ifdef GRAVSIM_MPI
+
+#include "parallel.h"
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <vector>
+
+// A body owned by this rank. The id is its index in the simulation rank
+// 0 set up, so that the results can be put back in order at the end.
+struct OwnedBody {
+    BodyPhysics physics;
+    int id;
+};
+
+// All that's needed to be attracted by a body
+struct Source {
+    glm::vec3 position;
+    float mass;
+};
+
+// Published by every rank each step, so that the others can tell
+// whether they need its bodies or only its centre of mass
+struct DomainSummary {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 centre_of_mass;
+    float mass;
+    int count;
+};
+
+// A body's position when rebalancing
+struct Placement {
+    glm::vec3 position;
+    int slot;       // Index into the gathered placements
+};
+
+static MPI_Datatype contiguous_type(size_t size)
+{
+    MPI_Datatype type;
+    MPI_Type_contiguous(size, MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+// Orthogonal recursive bisection. Splits the bodies at the median of
+// their longest axis, in proportion to the ranks on each side, until
+// each rank has a compact box with its share of the bodies.
+static void bisect(std::span<Placement> bodies, int first_rank, int num_ranks,
+                   std::vector<int>& owners)
+{
+    if (num_ranks == 1) {
+        for (const auto& body : bodies) {
+            owners[body.slot] = first_rank;
+        }
+        return;
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (const auto& body : bodies) {
+        min = glm::min(min, body.position);
+        max = glm::max(max, body.position);
+    }
+    glm::vec3 extent = max - min;
+    int axis = (extent.x > extent.y)
+        ? (extent.x > extent.z ? 0 : 2)
+        : (extent.y > extent.z ? 1 : 2);
+
+    int left_ranks = num_ranks / 2;
+    size_t split = bodies.size() * left_ranks / num_ranks;
+    std::nth_element(
+        bodies.begin(), bodies.begin() + split, bodies.end(),
+        [axis](const Placement& a, const Placement& b) {
+            return a.position[axis] < b.position[axis];
+        });
+
+    bisect(bodies.first(split), first_rank, left_ranks, owners);
+    bisect(bodies.subspan(split), first_rank + left_ranks,
+           num_ranks - left_ranks, owners);
+}
+
+// Whether the target domain's bodies can treat the source domain as a
+// point mass, i.e. it's small compared to its distance from all of them
+static bool far_enough(const DomainSummary& target,
+                       const DomainSummary& source, float theta)
+{
+    if (source.count == 0 || target.count == 0) {
+        return true;
+    }
+
+    glm::vec3 extent = source.max - source.min;
+    float size = std::max({ extent.x, extent.y, extent.z });
+    glm::vec3 closest = glm::clamp(source.centre_of_mass, target.min, target.max);
+    float distance = glm::length(source.centre_of_mass - closest);
+    return size < theta * distance;
+}
+
+// Adds the pull of every source to each body, as update_forces does.
+// Sources at the body's own position, such as itself, are skipped.
+static void add_accelerations(std::span<const Source> bodies,
+                              std::span<const Source> sources,
+                              std::span<glm::vec3> accelerations)
+{
+    constexpr float epsilon = 0.0001;
+
+    parallel_for(bodies.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            glm::vec3 acceleration(0.0f);
+            for (const auto& source : sources) {
+                glm::vec3 delta = source.position - bodies[i].position;
+                float radius = glm::length(delta);
+                if (radius > epsilon) {
+                    float r3 = radius * radius * radius;
+                    acceleration += delta * (GRAV_CONSTANT * source.mass / r3);
+                }
+            }
+            accelerations[i] += acceleration;
+        }
+    }, 64);
+}
+
+// This rank's share of the simulation
+class DistributedSimulation {
+    int rank;
+    int num_ranks;
+    MPI_Datatype body_type;
+    MPI_Datatype source_type;
+    MPI_Datatype summary_type;
+    MPI_Datatype placement_type;
+
+    std::vector<OwnedBody> bodies;
+
+    // Reused between steps
+    std::vector<DomainSummary> summaries;
+    std::vector<Source> sources;
+    std::vector<Source> imported;
+    std::vector<glm::vec3> accelerations;
+    std::vector<MPI_Request> requests;
+
+public:
+    DistributedSimulation();
+    ~DistributedSimulation();
+
+    int get_rank() const { return rank; }
+    int get_num_ranks() const { return num_ranks; }
+    int num_local() const { return bodies.size(); }
+
+    // Splits rank 0's simulation between the ranks
+    void scatter(const Simulation& simulation);
+    // Puts every rank's bodies back into rank 0's simulation
+    void gather(Simulation& simulation);
+    void rebalance();
+    // One Euler step of time_step, as Simulation::step_bodies
+    void step(float theta, float time_step);
+
+private:
+    DomainSummary summarise() const;
+};
+
+DistributedSimulation::DistributedSimulation()
+{
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+    body_type      = contiguous_type(sizeof(OwnedBody));
+    source_type    = contiguous_type(sizeof(Source));
+    summary_type   = contiguous_type(sizeof(DomainSummary));
+    placement_type = contiguous_type(sizeof(Placement));
+    summaries.resize(num_ranks);
+}
+
+DistributedSimulation::~DistributedSimulation()
+{
+    MPI_Type_free(&body_type);
+    MPI_Type_free(&source_type);
+    MPI_Type_free(&summary_type);
+    MPI_Type_free(&placement_type);
+}
+
+void DistributedSimulation::scatter(const Simulation& simulation)
+{
+    int total = simulation.num_bodies;
+    MPI_Bcast(&total, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    // Contiguous blocks to start with, rebalanced straight after
+    std::vector<int> counts(num_ranks), offsets(num_ranks);
+    for (int r = 0; r < num_ranks; ++r) {
+        offsets[r] = (long long) total * r / num_ranks;
+        counts[r]  = (long long) total * (r + 1) / num_ranks - offsets[r];
+    }
+
+    std::vector<OwnedBody> all;
+    if (rank == 0) {
+        all.resize(total);
+        for (int i = 0; i < total; ++i) {
+            all[i] = OwnedBody{ simulation.body_physics[i], i };
+        }
+    }
+
+    bodies.resize(counts[rank]);
+    MPI_Scatterv(all.data(), counts.data(), offsets.data(), body_type,
+                 bodies.data(), counts[rank], body_type, 0, MPI_COMM_WORLD);
+}
+
+void DistributedSimulation::gather(Simulation& simulation)
+{
+    int count = bodies.size();
+    std::vector<int> counts(num_ranks), offsets(num_ranks);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::exclusive_scan(counts.begin(), counts.end(), offsets.begin(), 0);
+
+    std::vector<OwnedBody> all;
+    if (rank == 0) {
+        all.resize(offsets.back() + counts.back());
+    }
+    MPI_Gatherv(bodies.data(), count, body_type, all.data(),
+                counts.data(), offsets.data(), body_type, 0, MPI_COMM_WORLD);
+
+    for (const auto& body : all) {
+        simulation.body_physics[body.id] = body.physics;
+    }
+}
+
+void DistributedSimulation::rebalance()
+{
+    // Every rank gathers every position, then computes the same
+    // bisection, so they agree on the new owners without asking
+    int count = bodies.size();
+    std::vector<int> counts(num_ranks), offsets(num_ranks);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    std::exclusive_scan(counts.begin(), counts.end(), offsets.begin(), 0);
+    int total = offsets.back() + counts.back();
+
+    std::vector<Placement> local(count);
+    for (int i = 0; i < count; ++i) {
+        local[i] = Placement{ bodies[i].physics.position, offsets[rank] + i };
+    }
+    std::vector<Placement> placements(total);
+    MPI_Allgatherv(local.data(), count, placement_type, placements.data(),
+                   counts.data(), offsets.data(), placement_type, MPI_COMM_WORLD);
+
+    std::vector<int> owners(total);
+    bisect(placements, 0, num_ranks, owners);
+
+    // Send each body to its new owner, grouped by owner
+    std::vector<int> send_counts(num_ranks, 0), send_offsets(num_ranks);
+    for (int i = 0; i < count; ++i) {
+        ++send_counts[owners[offsets[rank] + i]];
+    }
+    std::exclusive_scan(send_counts.begin(), send_counts.end(),
+                        send_offsets.begin(), 0);
+
+    std::vector<OwnedBody> outgoing(count);
+    auto next = send_offsets;
+    for (int i = 0; i < count; ++i) {
+        outgoing[next[owners[offsets[rank] + i]]++] = bodies[i];
+    }
+
+    std::vector<int> recv_counts(num_ranks), recv_offsets(num_ranks);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT,
+                 recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    std::exclusive_scan(recv_counts.begin(), recv_counts.end(),
+                        recv_offsets.begin(), 0);
+
+    bodies.resize(recv_offsets.back() + recv_counts.back());
+    MPI_Alltoallv(outgoing.data(), send_counts.data(), send_offsets.data(), body_type,
+                  bodies.data(), recv_counts.data(), recv_offsets.data(), body_type,
+                  MPI_COMM_WORLD);
+}
+
+DomainSummary DistributedSimulation::summarise() const
+{
+    DomainSummary summary {
+        glm::vec3(std::numeric_limits<float>::max()),
+        glm::vec3(std::numeric_limits<float>::lowest()),
+        glm::vec3(0.0f),
+        0.0f,
+        (int) bodies.size()
+    };
+
+    for (const auto& body : bodies) {
+        const auto& physics = body.physics;
+        summary.min = glm::min(summary.min, physics.position);
+        summary.max = glm::max(summary.max, physics.position);
+        summary.centre_of_mass += physics.position * physics.mass;
+        summary.mass += physics.mass;
+    }
+    if (summary.mass > 0.0f) {
+        summary.centre_of_mass /= summary.mass;
+    }
+    return summary;
+}
+
+void DistributedSimulation::step(float theta, float time_step)
+{
+    auto own = summarise();
+    MPI_Allgather(&own, 1, summary_type, summaries.data(), 1, summary_type,
+                  MPI_COMM_WORLD);
+
+    int count = bodies.size();
+    sources.resize(count);
+    for (int i = 0; i < count; ++i) {
+        sources[i] = Source{ bodies[i].physics.position, bodies[i].physics.mass };
+    }
+
+    // Exchange bodies with the ranks too close to approximate. Every
+    // rank has every summary, so both sides of each exchange agree.
+    int num_imported = 0;
+    for (int r = 0; r < num_ranks; ++r) {
+        if (r != rank && !far_enough(own, summaries[r], theta)) {
+            num_imported += summaries[r].count;
+        }
+    }
+    imported.resize(num_imported);
+    requests.clear();
+
+    int offset = 0;
+    for (int r = 0; r < num_ranks; ++r) {
+        if (r == rank) {
+            continue;
+        }
+        if (!far_enough(own, summaries[r], theta)) {
+            requests.emplace_back();
+            MPI_Irecv(imported.data() + offset, summaries[r].count, source_type,
+                      r, 0, MPI_COMM_WORLD, &requests.back());
+            offset += summaries[r].count;
+        }
+        if (!far_enough(summaries[r], own, theta)) {
+            requests.emplace_back();
+            MPI_Isend(sources.data(), count, source_type,
+                      r, 0, MPI_COMM_WORLD, &requests.back());
+        }
+    }
+
+    // This rank's own bodies attract each other while the others arrive
+    accelerations.assign(count, glm::vec3(0.0f));
+    add_accelerations(sources, sources, accelerations);
+
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+    // The distant ranks only pull as their centres of mass
+    for (int r = 0; r < num_ranks; ++r) {
+        if (r != rank && summaries[r].count > 0 && far_enough(own, summaries[r], theta)) {
+            imported.push_back(Source{ summaries[r].centre_of_mass, summaries[r].mass });
+        }
+    }
+    add_accelerations(sources, imported, accelerations);
+
+    for (int i = 0; i < count; ++i) {
+        auto& physics = bodies[i].physics;
+        physics.velocity += accelerations[i] * time_step;
+        physics.position += physics.velocity * time_step;
+    }
+}
+
+static int run(const HeadlessOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+
+    auto seconds_since = [](Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    DistributedSimulation distributed;
+    bool root = distributed.get_rank() == 0;
+
+    // Only rank 0 holds the whole scene, to scatter and save it
+    Simulation simulation;
+    // Wisdom-Holman needs every body around the central one in 
+    // one place, so only the Euler integrator is split up
+    int euler = 1;
+    float time_step = 1.0f;
+    if (root) {
+        prepare_simulation(simulation, options);
+        euler = simulation.integrator_central_body() == Simulation::NO_INDEX;
+        time_step = simulation.integrator_settings.time_step;
+        if (!euler) {
+            std::cerr << "The scene uses the Wisdom-Holman integrator, which can't "
+                         "be distributed. Run it with --integrator euler\n";
+        } else {
+            std::cout << "Running " << simulation.num_bodies << " bodies on "
+                      << distributed.get_num_ranks() << " ranks for "
+                      << options.steps << " steps\n";
+        }
+    }
+    MPI_Bcast(&euler, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&time_step, 1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    if (!euler) {
+        return 1;
+    }
+
+    distributed.scatter(simulation);
+    distributed.rebalance();
+
+    auto start = Clock::now();
+
+    for (int step = 1; step <= options.steps; ++step) {
+        distributed.step(options.theta, time_step);
+
+        if (options.rebalance_every > 0 && step % options.rebalance_every == 0) {
+            distributed.rebalance();
+        }
+
+        if (options.report_every > 0 && step % options.report_every == 0) {
+            int local = distributed.num_local();
+            int fewest, most;
+            MPI_Reduce(&local, &fewest, 1, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+            MPI_Reduce(&local, &most,   1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+
+            if (root) {
+                double elapsed = seconds_since(start);
+                std::cout << "step " << step << ": " << elapsed << "s, "
+                          << step / elapsed << " steps/s, "
+                          << fewest << "-" << most << " bodies per rank\n";
+            }
+        }
+    }
+
+    distributed.gather(simulation);
+
+    if (root) {
+        std::cout << "Finished in " << seconds_since(start) << "s\n";
+        if (!options.save_path.empty()) {
+            simulation.save_simulation(options.save_path);
+        }
+    }
+    return 0;
+}
+
+int run_distributed(const HeadlessOptions& options)
+{
+    MPI_Init(nullptr, nullptr);
+    int result = run(options);
+    MPI_Finalize();
+    return result;
+}
+
+#else
+
+int run_distributed(const HeadlessOptions&)
+{
+    std::cerr << "This build has no MPI support, build it with "
+                 "make distributed\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "headless.h"
+
+// Runs a headless simulation with the bodies split across MPI ranks, e.g.
+//   mpirun -n 4 binaries/distributed --headless --distributed
+//          --generate plummer --count 100000 --steps 500
+// Rank 0 sets up the scene, reports progress and saves the result.
+// Needs a build with GRAVSIM_MPI defined (make distributed), otherwise
+// it reports an error.
+int run_distributed(const HeadlessOptions& options);
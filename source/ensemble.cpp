@@ -0,0 +1,491 @@
+#include "ensemble.h"
+#include "simulation.h"
+#include "parallel.h"
+#include "random.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string_view>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+static void print_usage()
+{
+    std::cout
+        << "Usage: prog --ensemble <base.sim> [options]\n"
+        << "  --grid <target>=<min>:<max>:<n>\n"
+        << "                         Add n evenly spaced offsets to the\n"
+        << "                         target, one grid axis per --grid\n"
+        << "  --perturb <target>=<sigma>\n"
+        << "                         Add a random offset to the target for\n"
+        << "                         each member, normally distributed\n"
+        << "  --samples <n>          Members per grid point\n"
+        << "  --seed <n>             Seed for the perturbations\n"
+        << "  --steps <n>            Number of steps to run each member\n"
+        << "  --escape <x>           Distance from the centre of mass, as a\n"
+        << "                         multiple of the starting size, that\n"
+        << "                         counts as having escaped\n"
+        << "  --output <file.csv>    Where to write the summaries\n"
+        << "  A target is <body>.<field>, or <field> for every body, where\n"
+        << "  field is x, y, z, vx, vy, vz or mass, e.g. 2.vx\n";
+}
+
+// Parses "<body>.<field>" or "<field>"
+static bool parse_target(std::string_view text, EnsembleTarget& target)
+{
+    target.body = -1;
+    auto dot = text.find('.');
+    if (dot != std::string_view::npos) {
+        target.body = std::atoi(std::string(text.substr(0, dot)).c_str());
+        text = text.substr(dot + 1);
+    }
+
+    for (int i = 0; i < int(std::size(ENSEMBLE_FIELD_NAMES)); ++i) {
+        if (text == ENSEMBLE_FIELD_NAMES[i]) {
+            target.field = EnsembleField(i);
+            return target.body >= -1;
+        }
+    }
+    return false;
+}
+
+bool parse_ensemble_options(int argc, char **argv, EnsembleOptions& options)
+{
+    if (argc < 3) {
+        print_usage();
+        return false;
+    }
+    options.base_path = argv[2];
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const char *arg   = argv[i];
+        const char *value = argv[i + 1];
+
+        // Targets are followed by '=' and their values
+        std::string_view spec(value);
+        auto equals = spec.find('=');
+        EnsembleTarget target;
+        bool has_target = equals != std::string_view::npos
+                       && parse_target(spec.substr(0, equals), target);
+        const char *values = value + equals + 1;
+
+        if (std::strcmp(arg, "--grid") == 0) {
+            EnsembleGridAxis axis;
+            axis.target = target;
+            if (!has_target || std::sscanf(values, "%f:%f:%d",
+                    &axis.min, &axis.max, &axis.count) != 3 || axis.count < 1) {
+                print_usage();
+                return false;
+            }
+            options.grid.push_back(axis);
+        } else if (std::strcmp(arg, "--perturb") == 0) {
+            EnsemblePerturbation perturbation;
+            perturbation.target = target;
+            if (!has_target || std::sscanf(values, "%f", &perturbation.sigma) != 1) {
+                print_usage();
+                return false;
+            }
+            options.perturbations.push_back(perturbation);
+        } else if (std::strcmp(arg, "--samples") == 0) {
+            options.samples = std::atoi(value);
+        } else if (std::strcmp(arg, "--seed") == 0) {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(arg, "--steps") == 0) {
+            options.steps = std::atoi(value);
+        } else if (std::strcmp(arg, "--escape") == 0) {
+            options.escape_factor = std::atof(value);
+        } else if (std::strcmp(arg, "--output") == 0) {
+            options.output_path = value;
+        } else {
+            print_usage();
+            return false;
+        }
+    }
+
+    if ((argc - 3) % 2 != 0 || options.samples < 1) {
+        print_usage();
+        return false;
+    }
+    return true;
+}
+
+static void apply_offset(std::vector<BodyPhysics>& bodies,
+                         const EnsembleTarget& target, float offset)
+{
+    int first = (target.body < 0) ? 0 : target.body;
+    int last  = (target.body < 0) ? bodies.size() : target.body + 1;
+
+    for (int i = first; i < last; ++i) {
+        auto& physics = bodies[i];
+        switch (target.field) {
+        case EnsembleField::X:    physics.position.x += offset; break;
+        case EnsembleField::Y:    physics.position.y += offset; break;
+        case EnsembleField::Z:    physics.position.z += offset; break;
+        case EnsembleField::VX:   physics.velocity.x += offset; break;
+        case EnsembleField::VY:   physics.velocity.y += offset; break;
+        case EnsembleField::VZ:   physics.velocity.z += offset; break;
+        case EnsembleField::Mass: physics.mass       += offset; break;
+        }
+    }
+}
+
+// Offset of a grid axis at a point along it
+static float grid_offset(const EnsembleGridAxis& axis, int index)
+{
+    if (axis.count == 1) {
+        return axis.min;
+    }
+    return axis.min + (axis.max - axis.min) * index / (axis.count - 1);
+}
+
+// Four members integrated together, one per SIMD lane. The arrays are
+// indexed [body * LANES + lane], so a body's four copies are adjacent.
+struct EnsembleBatch {
+    static constexpr int LANES = 4;
+
+    int num_bodies;
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> mass;
+    std::vector<float> ax, ay, az;
+
+    explicit EnsembleBatch(int bodies)
+    : num_bodies(bodies)
+    {
+        for (auto array : { &x, &y, &z, &vx, &vy, &vz, &mass, &ax, &ay, &az }) {
+            array->resize(bodies * LANES);
+        }
+    }
+
+    void set_member(int lane, const std::vector<BodyPhysics>& bodies)
+    {
+        for (int i = 0; i < num_bodies; ++i) {
+            int k = i * LANES + lane;
+            x[k]  = bodies[i].position.x;
+            y[k]  = bodies[i].position.y;
+            z[k]  = bodies[i].position.z;
+            vx[k] = bodies[i].velocity.x;
+            vy[k] = bodies[i].velocity.y;
+            vz[k] = bodies[i].velocity.z;
+            mass[k] = bodies[i].mass;
+        }
+    }
+
+    // Kinetic plus potential energy of one member
+    double energy(int lane) const
+    {
+        double total = 0.0;
+        for (int i = 0; i < num_bodies; ++i) {
+            int a = i * LANES + lane;
+            double v2 = double(vx[a]) * vx[a] + double(vy[a]) * vy[a]
+                      + double(vz[a]) * vz[a];
+            total += 0.5 * mass[a] * v2;
+
+            for (int j = i + 1; j < num_bodies; ++j) {
+                int b = j * LANES + lane;
+                double dx = x[b] - x[a], dy = y[b] - y[a], dz = z[b] - z[a];
+                double r  = std::sqrt(dx * dx + dy * dy + dz * dz);
+                if (r > 0.0001) {
+                    total -= GRAV_CONSTANT * double(mass[a]) * mass[b] / r;
+                }
+            }
+        }
+        return total;
+    }
+
+    // One Euler step of time_step, as Simulation::step_bodies. Also
+    // lowers each lane of min_r2 to its closest squared separation.
+    void step(float *min_r2, float time_step);
+
+    // Squared distance of each member's furthest body from its centre of mass
+    void max_spread(float *spread) const;
+};
+
+void EnsembleBatch::step(float *min_r2, float time_step)
+{
+    constexpr float epsilon = 0.0001;
+    int i = 0;
+
+#if defined(__SSE__)
+    __m128 closest = _mm_loadu_ps(min_r2);
+    __m128 eps = _mm_set1_ps(epsilon);
+    __m128 g   = _mm_set1_ps(GRAV_CONSTANT);
+
+    for (; i < num_bodies; ++i) {
+        int a = i * LANES;
+        __m128 xi = _mm_loadu_ps(&x[a]);
+        __m128 yi = _mm_loadu_ps(&y[a]);
+        __m128 zi = _mm_loadu_ps(&z[a]);
+        __m128 sum_x = _mm_setzero_ps();
+        __m128 sum_y = _mm_setzero_ps();
+        __m128 sum_z = _mm_setzero_ps();
+
+        for (int j = 0; j < num_bodies; ++j) {
+            if (i == j) {
+                continue;
+            }
+            int b = j * LANES;
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&x[b]), xi);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(&y[b]), yi);
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(&z[b]), zi);
+            __m128 r2 = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                _mm_mul_ps(dz, dz));
+            closest = _mm_min_ps(closest, r2);
+
+            // a = Gm/r^2 along delta / r, dropped where r <= epsilon
+            __m128 r = _mm_sqrt_ps(r2);
+            __m128 s = _mm_div_ps(
+                _mm_mul_ps(g, _mm_loadu_ps(&mass[b])),
+                _mm_mul_ps(r2, r));
+            s = _mm_and_ps(s, _mm_cmpgt_ps(r, eps));
+
+            sum_x = _mm_add_ps(sum_x, _mm_mul_ps(dx, s));
+            sum_y = _mm_add_ps(sum_y, _mm_mul_ps(dy, s));
+            sum_z = _mm_add_ps(sum_z, _mm_mul_ps(dz, s));
+        }
+
+        _mm_storeu_ps(&ax[a], sum_x);
+        _mm_storeu_ps(&ay[a], sum_y);
+        _mm_storeu_ps(&az[a], sum_z);
+    }
+    _mm_storeu_ps(min_r2, closest);
+#endif
+
+    // Everything, without SSE
+    for (; i < num_bodies; ++i) {
+        for (int lane = 0; lane < LANES; ++lane) {
+            int a = i * LANES + lane;
+            float sum_x = 0.0f, sum_y = 0.0f, sum_z = 0.0f;
+
+            for (int j = 0; j < num_bodies; ++j) {
+                if (i == j) {
+                    continue;
+                }
+                int b = j * LANES + lane;
+                float dx = x[b] - x[a], dy = y[b] - y[a], dz = z[b] - z[a];
+                float r2 = dx * dx + dy * dy + dz * dz;
+                float r  = std::sqrt(r2);
+                min_r2[lane] = std::min(min_r2[lane], r2);
+
+                if (r > epsilon) {
+                    float s = GRAV_CONSTANT * mass[b] / (r2 * r);
+                    sum_x += dx * s;
+                    sum_y += dy * s;
+                    sum_z += dz * s;
+                }
+            }
+
+            ax[a] = sum_x;
+            ay[a] = sum_y;
+            az[a] = sum_z;
+        }
+    }
+
+    // Plain loops over adjacent lanes, which the compiler vectorises
+    int count = num_bodies * LANES;
+    for (int k = 0; k < count; ++k) {
+        vx[k] += ax[k] * time_step;
+        vy[k] += ay[k] * time_step;
+        vz[k] += az[k] * time_step;
+        x[k] += vx[k] * time_step;
+        y[k] += vy[k] * time_step;
+        z[k] += vz[k] * time_step;
+    }
+}
+
+void EnsembleBatch::max_spread(float *spread) const
+{
+    float cx[LANES] = {}, cy[LANES] = {}, cz[LANES] = {}, total[LANES] = {};
+    for (int i = 0; i < num_bodies; ++i) {
+        for (int lane = 0; lane < LANES; ++lane) {
+            int k = i * LANES + lane;
+            cx[lane] += x[k] * mass[k];
+            cy[lane] += y[k] * mass[k];
+            cz[lane] += z[k] * mass[k];
+            total[lane] += mass[k];
+        }
+    }
+
+    for (int lane = 0; lane < LANES; ++lane) {
+        cx[lane] /= total[lane];
+        cy[lane] /= total[lane];
+        cz[lane] /= total[lane];
+        spread[lane] = 0.0f;
+    }
+
+    for (int i = 0; i < num_bodies; ++i) {
+        for (int lane = 0; lane < LANES; ++lane) {
+            int k = i * LANES + lane;
+            float dx = x[k] - cx[lane], dy = y[k] - cy[lane], dz = z[k] - cz[lane];
+            spread[lane] = std::max(spread[lane], dx * dx + dy * dy + dz * dz);
+        }
+    }
+}
+
+int run_ensemble(const EnsembleOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr int LANES = EnsembleBatch::LANES;
+
+    Simulation base;
+    base.load_simulation(options.base_path);
+    int num_bodies = base.num_bodies;
+    if (num_bodies == 0) {
+        std::cerr << "No bodies in " << options.base_path << "\n";
+        return 1;
+    }
+
+    // Members are stepped four at a time with Euler, so a scene saved
+    // for Wisdom-Holman would give results that don't match the editor
+    if (base.integrator_central_body() != Simulation::NO_INDEX) {
+        std::cerr << options.base_path << " uses the Wisdom-Holman integrator, "
+                     "which ensembles don't support. Save it with the Euler one\n";
+        return 1;
+    }
+    float time_step = base.integrator_settings.time_step;
+
+    for (const auto& axis : options.grid) {
+        if (axis.target.body >= num_bodies) {
+            std::cerr << "No body " << axis.target.body << " to vary\n";
+            return 1;
+        }
+    }
+    for (const auto& perturbation : options.perturbations) {
+        if (perturbation.target.body >= num_bodies) {
+            std::cerr << "No body " << perturbation.target.body << " to vary\n";
+            return 1;
+        }
+    }
+
+    // Members run from the scene's starting state, as it was edited
+    std::vector<BodyPhysics> start(base.body_physics);
+    for (auto& physics : start) {
+        physics.position = physics.orig_position;
+        physics.velocity = physics.orig_velocity;
+    }
+
+    // The last grid axis varies fastest, then the samples of each point
+    int grid_points = 1;
+    for (const auto& axis : options.grid) {
+        grid_points *= axis.count;
+    }
+    int num_members = grid_points * options.samples;
+    int num_batches = (num_members + LANES - 1) / LANES;
+
+    auto member_state = [&](int member, std::vector<BodyPhysics>& bodies) {
+        bodies = start;
+        int point = member / options.samples;
+        for (int a = options.grid.size() - 1; a >= 0; --a) {
+            const auto& axis = options.grid[a];
+            apply_offset(bodies, axis.target, grid_offset(axis, point % axis.count));
+            point /= axis.count;
+        }
+
+        Random random(options.seed, member);
+        for (const auto& perturbation : options.perturbations) {
+            apply_offset(bodies, perturbation.target,
+                         perturbation.sigma * random.normal());
+        }
+    };
+
+    std::vector<EnsembleSummary> summaries(num_members);
+    auto started = Clock::now();
+
+    parallel_for(num_batches, [&](int begin, int end) {
+        EnsembleBatch batch(num_bodies);
+        std::vector<BodyPhysics> bodies;
+
+        for (int b = begin; b < end; ++b) {
+            // Spare lanes in the last batch repeat its last member
+            int first = b * LANES;
+            for (int lane = 0; lane < LANES; ++lane) {
+                member_state(std::min(first + lane, num_members - 1), bodies);
+                batch.set_member(lane, bodies);
+            }
+
+            double energy[LANES];
+            float spread[LANES], escape_r2[LANES];
+            float min_r2[LANES];
+            int escape_step[LANES];
+            batch.max_spread(spread);
+            for (int lane = 0; lane < LANES; ++lane) {
+                energy[lane] = batch.energy(lane);
+                escape_r2[lane] = spread[lane] * options.escape_factor
+                                               * options.escape_factor;
+                min_r2[lane] = std::numeric_limits<float>::max();
+                escape_step[lane] = -1;
+            }
+
+            for (int step = 1; step <= options.steps; ++step) {
+                batch.step(min_r2, time_step);
+
+                batch.max_spread(spread);
+                for (int lane = 0; lane < LANES; ++lane) {
+                    if (escape_step[lane] < 0 && spread[lane] > escape_r2[lane]) {
+                        escape_step[lane] = step;
+                    }
+                }
+            }
+
+            for (int lane = 0; lane < LANES && first + lane < num_members; ++lane) {
+                double drift = (batch.energy(lane) - energy[lane]) / std::abs(energy[lane]);
+                summaries[first + lane] = EnsembleSummary {
+                    std::sqrt(min_r2[lane]),
+                    escape_step[lane],
+                    (float) drift
+                };
+            }
+        }
+    }, 1);
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+    std::ofstream file;
+    if (!options.output_path.empty()) {
+        file.open(options.output_path);
+        if (!file.good()) {
+            std::cerr << "Couldn't open " << options.output_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = options.output_path.empty() ? std::cout : file;
+
+    out << "member";
+    for (const auto& axis : options.grid) {
+        out << ",";
+        if (axis.target.body >= 0) {
+            out << axis.target.body << ".";
+        }
+        out << ENSEMBLE_FIELD_NAMES[int(axis.target.field)];
+    }
+    out << ",min_separation,escape_step,energy_drift\n";
+
+    for (int member = 0; member < num_members; ++member) {
+        out << member;
+        int point = member / options.samples;
+        int stride = grid_points;
+        for (const auto& axis : options.grid) {
+            stride /= axis.count;
+            out << "," << grid_offset(axis, point / stride % axis.count);
+        }
+        const auto& summary = summaries[member];
+        out << "," << summary.min_separation
+            << "," << summary.escape_step
+            << "," << summary.energy_drift << "\n";
+    }
+
+    if (!options.output_path.empty()) {
+        std::cout << "Ran " << num_members << " members of " << num_bodies
+                  << " bodies for " << options.steps << " steps in "
+                  << elapsed << "s\n";
+    }
+    return 0;
+}
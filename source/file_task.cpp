@@ -0,0 +1,70 @@
+#include "file_task.h"
+#include "file_util.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+SimulationFileTask::SimulationFileTask(const std::string& path)
+    : file_path(path), task_kind(FileTaskKind::Load)
+{
+    worker = std::thread(&SimulationFileTask::load, this);
+}
+
+SimulationFileTask::SimulationFileTask(const std::string& path, SimulationSnapshot&& scene)
+    : file_path(path), task_kind(FileTaskKind::Save), snapshot(std::move(scene))
+{
+    worker = std::thread(&SimulationFileTask::save, this);
+}
+
+SimulationFileTask::SimulationFileTask(const CatalogueOptions& options)
+    : file_path(options.path), task_kind(FileTaskKind::Import), catalogue(options)
+{
+    catalogue.cancel   = &cancelled;
+    catalogue.progress = &fraction;
+    worker = std::thread(&SimulationFileTask::import, this);
+}
+
+SimulationFileTask::~SimulationFileTask()
+{
+    cancel();
+    worker.join();
+}
+
+void SimulationFileTask::load()
+{
+    std::ifstream file(file_path, std::ios::binary);
+    ok = file.good() && read_snapshot(file, snapshot, &cancelled, &fraction);
+    if (!ok && !cancelled) {
+        std::cerr << "Failed to load " << file_path << "\n";
+    }
+    finished.store(true, std::memory_order_release);
+}
+
+void SimulationFileTask::save()
+{
+    // Serialising is quick next to the disk, so the progress
+    // is that of the write
+    std::ostringstream file;
+    write_snapshot(file, snapshot);
+    ok = write_file_atomically(file_path, file.str(), &fraction, &cancelled);
+    if (!ok && !cancelled) {
+        std::cerr << "Failed to save " << file_path << "\n";
+    }
+    finished.store(true, std::memory_order_release);
+}
+
+void SimulationFileTask::import()
+{
+    // Into a scene of its own, as the simulation
+    // keeps running on the main thread meanwhile
+    Simulation imported;
+    auto result = import_catalogue(imported, catalogue);
+    ok = result.ok;
+    if (ok) {
+        snapshot = imported.snapshot();
+    } else if (!cancelled) {
+        std::cerr << "Failed to import " << file_path << "\n";
+    }
+    finished.store(true, std::memory_order_release);
+}
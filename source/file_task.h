@@ -0,0 +1,59 @@
+#pragma once
+
+#include "simulation.h"
+#include "catalogue.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+enum class FileTaskKind {
+    Load, Save, Import
+};
+
+// Loads or saves a .sim file, or imports a catalogue, on a thread of its
+// own, so the window keeps drawing while a large file is read or written.
+// A load or import fills in a snapshot, which is swapped into or added to
+// the simulation once it's done. A save writes a snapshot taken when it
+// started, so the simulation can keep running meanwhile.
+class SimulationFileTask {
+public:
+    // Starts loading the file at path
+    explicit SimulationFileTask(const std::string& path);
+    // Starts saving scene to path
+    SimulationFileTask(const std::string& path, SimulationSnapshot&& scene);
+    // Starts importing the catalogue into a scene of its own
+    explicit SimulationFileTask(const CatalogueOptions& options);
+    // Cancels the task if it's still going, and waits for it to stop
+    ~SimulationFileTask();
+    SimulationFileTask(const SimulationFileTask&) = delete;
+    SimulationFileTask& operator=(const SimulationFileTask&) = delete;
+
+    FileTaskKind kind() const { return task_kind; }
+    const std::string& path() const { return file_path; }
+    bool done() const { return finished.load(std::memory_order_acquire); }
+    // Whether the file was read or written completely. Only valid once done.
+    bool succeeded() const { return ok; }
+    // From 0 to 1
+    float progress() const { return fraction.load(std::memory_order_relaxed); }
+    // Asks the task to stop. A cancelled save leaves any previous
+    // file in place, and a cancelled load leaves the simulation alone.
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    // The loaded or imported bodies, for the simulation once done
+    SimulationSnapshot& result() { return snapshot; }
+
+private:
+    std::string file_path;
+    FileTaskKind task_kind;
+    CatalogueOptions catalogue;
+    bool ok = false;
+    SimulationSnapshot snapshot;
+    std::atomic<float> fraction { 0.0f };
+    std::atomic<bool>  cancelled { false };
+    std::atomic<bool>  finished  { false };
+    std::thread worker;
+
+    void load();
+    void save();
+    void import();
+};
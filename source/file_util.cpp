@@ -0,0 +1,74 @@
+#include "file_util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+std::string directory_of(const std::string& path)
+{
+    auto slash = path.find_last_of('/');
+    return slash == std::string::npos
+        ? "."
+        : path.substr(0, slash + 1);
+}
+
+bool write_file_atomically(const std::string& path, const std::string& data,
+                           std::atomic<float> *progress,
+                           const std::atomic<bool> *cancel)
+{
+    std::string temp_path = path + ".tmp";
+    std::string directory = directory_of(path);
+    return replace_file(path.c_str(), temp_path.c_str(), directory.c_str(),
+                        data, progress, cancel);
+}
+
+bool replace_file(const char *path, const char *temp_path, const char *directory,
+                  const std::string& data, std::atomic<float> *progress,
+                  const std::atomic<bool> *cancel)
+{
+    // Written in blocks, to report progress and check for cancellation
+    constexpr size_t BLOCK_SIZE = 4 << 20;
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    const char *bytes = data.data();
+    size_t remaining  = data.size();
+    bool ok = true;
+    while (ok && remaining > 0) {
+        ssize_t written = write(fd, bytes, std::min(remaining, BLOCK_SIZE));
+        if (written < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        bytes     += written;
+        remaining -= written;
+
+        if (progress) {
+            progress->store(1.0f - float(remaining) / data.size());
+        }
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            ok = false;
+        }
+    }
+    // The contents must be on disk before the rename can be
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    if (!ok || std::rename(temp_path, path) != 0) {
+        std::remove(temp_path);
+        return false;
+    }
+
+    // Make the rename itself durable, by syncing the directory
+    int dir_fd = open(directory, O_RDONLY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+// Replaces the file at path with data, so that after a crash it holds
+// either the old contents or the new ones. The data is written to a
+// temporary file, synced to disk and then renamed over the original.
+// Progress goes from 0 to 1 if given. Setting cancel abandons the
+// write, leaving the original file as it was.
+bool write_file_atomically(const std::string& path, const std::string& data,
+                           std::atomic<float> *progress = nullptr,
+                           const std::atomic<bool> *cancel = nullptr);
+
+// The same, taking every path ready made, so that it doesn't allocate.
+// temp_path is written first and directory is where path is.
+bool replace_file(const char *path, const char *temp_path, const char *directory,
+                  const std::string& data, std::atomic<float> *progress,
+                  const std::atomic<bool> *cancel);
+
+// The directory holding path, ending in a slash, or "."
+std::string directory_of(const std::string& path);
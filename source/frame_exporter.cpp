@@ -0,0 +1,276 @@
+#include "frame_exporter.h"
+#include "headless.h"
+
+#include <GL/glew.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void print_usage()
+{
+    std::cout 
+        << "Usage: prog --export <target> [options]\n"
+        << "  <target>               \"|command\" to pipe raw RGBA frames to\n"
+        << "                         an encoder, or a printf pattern for\n"
+        << "                         numbered PPM files, e.g. out/%05d.ppm\n"
+        << "  --size <w>x<h>         Resolution of the frames\n"
+        << "  --frames <n>           Number of frames to render\n"
+        << "  --steps-per-frame <n>  Simulation steps between frames\n"
+        << "  --distance <x>         Distance of the camera from the origin\n"
+        << "  --load <file.sim>      Load a saved simulation\n"
+        << "  --generate <scene>     Generate a scene, with --count, --seed,\n"
+        << "                         --scale and --mass as for --headless\n";
+}
+
+// A file pattern is passed to snprintf with the frame number, so it
+// must have exactly one integer conversion, e.g. %05d, and no others
+static bool valid_frame_pattern(const std::string& pattern)
+{
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') {
+            continue;
+        }
+        if (++i < pattern.size() && pattern[i] == '%') {
+            continue;
+        }
+        while (i < pattern.size() && std::strchr("-+ #0", pattern[i])) {
+            ++i;
+        }
+        while (i < pattern.size() && std::isdigit((unsigned char)pattern[i])) {
+            ++i;
+        }
+        if (i >= pattern.size() || !std::strchr("diuoxX", pattern[i])) {
+            return false;
+        }
+        ++conversions;
+    }
+    return conversions == 1;
+}
+
+bool parse_export_options(int argc, char **argv, ExportOptions& options)
+{
+    SceneParameters scene;
+    bool generate = false;
+
+    if (argc < 3) {
+        print_usage();
+        return false;
+    }
+    options.target = argv[2];
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const char *arg   = argv[i];
+        const char *value = argv[i + 1];
+
+        if (parse_scene_argument(arg, value, scene, generate)) {
+            continue;
+        } else if (std::strcmp(arg, "--size") == 0) {
+            if (std::sscanf(value, "%dx%d", &options.width, &options.height) != 2) {
+                print_usage();
+                return false;
+            }
+        } else if (std::strcmp(arg, "--frames") == 0) {
+            options.frames = std::atoi(value);
+        } else if (std::strcmp(arg, "--steps-per-frame") == 0) {
+            options.steps_per_frame = std::atoi(value);
+        } else if (std::strcmp(arg, "--distance") == 0) {
+            options.distance = std::atof(value);
+        } else if (std::strcmp(arg, "--load") == 0) {
+            options.load_path = value;
+        } else {
+            print_usage();
+            return false;
+        }
+    }
+
+    if ((argc - 3) % 2 != 0 || options.width <= 0 || options.height <= 0) {
+        print_usage();
+        return false;
+    }
+
+    if (options.target.empty() 
+        || (options.target[0] != '|' && !valid_frame_pattern(options.target))) {
+        std::cerr << "The frame pattern needs one integer conversion, e.g. %05d\n";
+        return false;
+    }
+
+    if (generate) {
+        options.scene = scene;
+    }
+    return true;
+}
+
+FrameExporter::FrameExporter(int w, int h, const std::string& target)
+: width(w), height(h), frame_bytes(size_t(w) * h * 4)
+{
+    if (!target.empty() && target[0] == '|') {
+        pipe = popen(target.c_str() + 1, "w");
+        if (pipe == nullptr) {
+            std::cerr << "Couldn't start " << target.c_str() + 1 << "\n";
+            failed = true;
+        }
+    } else {
+        pattern = target;
+    }
+
+    glGenBuffers(NUM_PBOS, pbos.data());
+    for (auto pbo : pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    free_frames.resize(NUM_FRAMES, Frame(frame_bytes));
+    writer = std::thread(&FrameExporter::write_frames, this);
+}
+
+FrameExporter::~FrameExporter()
+{
+    finish();
+    glDeleteBuffers(NUM_PBOS, pbos.data());
+}
+
+void FrameExporter::capture()
+{
+    // Once the ring is full, the oldest read has had 
+    // time to finish, so collect it before reusing its buffer
+    if (captured - collected == NUM_PBOS) {
+        collect();
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[captured % NUM_PBOS]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    ++captured;
+}
+
+void FrameExporter::collect()
+{
+    Frame frame;
+    {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [&] { return !free_frames.empty(); });
+        frame = std::move(free_frames.back());
+        free_frames.pop_back();
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[collected % NUM_PBOS]);
+    auto pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_bytes, GL_MAP_READ_BIT);
+    if (pixels != nullptr) {
+        std::memcpy(frame.data(), pixels, frame_bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    ++collected;
+
+    {
+        std::lock_guard lock(mutex);
+        queued.push_back(std::move(frame));
+    }
+    changed.notify_all();
+}
+
+void FrameExporter::finish()
+{
+    if (finished) {
+        return;
+    }
+    finished = true;
+
+    while (collected < captured) {
+        collect();
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    if (pipe != nullptr) {
+        pclose(pipe);
+        pipe = nullptr;
+    }
+}
+
+void FrameExporter::write_frames()
+{
+    std::vector<unsigned char> row(size_t(width) * 4);
+
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [&] { return closing || !queued.empty(); });
+            if (queued.empty()) {
+                return;
+            }
+            frame = std::move(queued.front());
+            queued.pop_front();
+        }
+
+        // Keep taking frames after a failure so the renderer never 
+        // blocks, but stop trying to write them
+        if (!failed) {
+            if (write_frame(frame, row)) {
+                ++written;
+            } else {
+                failed = true;
+            }
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            free_frames.push_back(std::move(frame));
+        }
+        changed.notify_all();
+    }
+}
+
+bool FrameExporter::write_frame(const Frame& frame, std::vector<unsigned char>& row)
+{
+    // OpenGL's rows start at the bottom of the image, so write them in 
+    // reverse to get the usual top to bottom order
+    size_t stride = size_t(width) * 4;
+
+    if (pipe != nullptr) {
+        for (int y = height - 1; y >= 0; --y) {
+            if (std::fwrite(&frame[y * stride], 1, stride, pipe) != stride) {
+                std::cerr << "Writing to the encoder failed\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // PPM files have no alpha, so pack each row down to RGB
+    char path[4096];
+    std::snprintf(path, sizeof(path), pattern.c_str(), written.load());
+    FILE *file = std::fopen(path, "wb");
+    if (file == nullptr) {
+        std::cerr << "Couldn't open " << path << "\n";
+        return false;
+    }
+
+    bool ok = std::fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+    size_t row_bytes = size_t(width) * 3;
+    for (int y = height - 1; y >= 0 && ok; --y) {
+        const unsigned char *source = &frame[y * stride];
+        for (int x = 0; x < width; ++x) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        ok = std::fwrite(row.data(), 1, row_bytes, file) == row_bytes;
+    }
+
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Writing " << path << " failed\n";
+    }
+    return ok;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "scene_generators.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Options for rendering a run to frames without showing a window, e.g.
+//   prog --export frames/%05d.ppm --size 1920x1080 --frames 600 --load a.sim
+struct ExportOptions {
+    // "|command" pipes raw RGBA frames to the command's stdin,
+    // anything else is a printf pattern for numbered PPM files
+    std::string target;
+    int width  = 1920;
+    int height = 1080;
+    int frames = 600;
+    int steps_per_frame = 1;
+    float distance = 0.0f;       // Camera distance, 0 keeps the default
+    std::string load_path;
+    std::optional<SceneParameters> scene;
+};
+
+bool parse_export_options(int argc, char **argv, ExportOptions& options);
+
+// Reads rendered frames back from the GPU and writes them out. Reads go
+// through a ring of pixel buffer objects, so each one is only mapped a
+// couple of frames after it was started and the GPU never has to stall.
+// A writer thread converts and writes the frames, so the renderer only
+// waits for the disk or the encoder if it gets a whole queue ahead.
+class FrameExporter {
+public:
+    FrameExporter(int w, int h, const std::string& target);
+    ~FrameExporter();
+
+    bool ok() const { return !failed; }
+    int frames_written() const { return written; }
+
+    // Start reading back the bound framebuffer's first colour attachment
+    void capture();
+    // Write out every captured frame and wait for the writer to finish
+    void finish();
+
+private:
+    static constexpr int NUM_PBOS   = 3;
+    static constexpr int NUM_FRAMES = 4;    // Frames queued for the writer
+
+    using Frame = std::vector<unsigned char>;
+
+    int width;
+    int height;
+    size_t frame_bytes;
+    std::array<unsigned, NUM_PBOS> pbos;
+    int captured  = 0;
+    int collected = 0;
+    bool finished = false;
+
+    // Output, only touched by the writer thread after construction,
+    // apart from the progress the renderer checks every frame
+    std::string pattern;
+    FILE *pipe = nullptr;
+    std::atomic<int>  written { 0 };
+    std::atomic<bool> failed { false };
+
+    // Frames are recycled between the two threads, so 
+    // exporting doesn't allocate once it's started
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Frame> free_frames;
+    std::deque<Frame> queued;
+    bool closing = false;
+    std::thread writer;
+
+    void collect();
+    void write_frames();
+    bool write_frame(const Frame& frame, std::vector<unsigned char>& row);
+};
@@ -3,6 +3,7 @@
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_opengl3.h>
 #include <misc/cpp/imgui_stdlib.h>
+#include <glm/gtc/type_ptr.hpp>
 #include <algorithm>
 #include <array>
 
@@ -16,7 +17,7 @@ void SimulationFrontend::init_graphics()
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
     SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
@@ -34,7 +35,9 @@ void SimulationFrontend::init_graphics()
         SDL_WINDOWPOS_CENTERED, 
         window_width, 
         window_height,
-        SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
+        offscreen 
+            ? SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN
+            : SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
     );
     context = SDL_GL_CreateContext(window);
     SDL_GL_MakeCurrent(window, context);
@@ -52,59 +55,148 @@ void SimulationFrontend::init_graphics()
 
 void SimulationFrontend::init_framebuffers()
 {
-    hdr_fbo              = new GLFrameBuffer(window_width, window_height);
-    bloom_horizontal_fbo = new GLFrameBuffer(window_width, window_height);
-    bloom_vertical_fbo   = new GLFrameBuffer(window_width, window_height);
+    hdr_fbo = new GLFrameBuffer(window_width, window_height);
 
     // HDR rendering framebuffer: one texture for regular rendering, one texture
     // for light emitters and a renderbuffer for the depth buffer
     hdr_fbo->attach_textures(2);
     hdr_fbo->attach_renderbuffer();
     hdr_fbo->check();
-    
-    // Bloom framebuffers: Each has one texture for 
-    // blurring the light emitter texture from hdr_fbo. 
-    bloom_horizontal_fbo->attach_textures(1);
-    bloom_horizontal_fbo->check();
 
-    bloom_vertical_fbo->attach_textures(1);
-    bloom_horizontal_fbo->check();
+    init_bloom_chain();
+}
+
+void SimulationFrontend::init_bloom_chain()
+{
+    // Bloom framebuffers: each has one texture holding the light emitter
+    // texture from hdr_fbo, blurred and shrunk. Stop early if the levels 
+    // get too small to be worth it.
+    constexpr int MIN_LEVEL_SIZE = 4;
+
+    int levels = BLOOM_LEVELS[static_cast<int>(bloom_quality)];
+    int width  = window_width / 2;
+    int height = window_height / 2;
+
+    for (int i = 0; i < levels; ++i) {
+        if (width < MIN_LEVEL_SIZE || height < MIN_LEVEL_SIZE) {
+            break;
+        }
+
+        // A packed float format halves the bandwidth of 
+        // RGBA16F, and the bloom doesn't need alpha
+        auto level = new GLFrameBuffer(width, height);
+        level->attach_textures(1, GL_R11F_G11F_B10F);
+        level->check();
+        bloom_chain.push_back(level);
+
+        width  /= 2;
+        height /= 2;
+    }
+}
+
+void SimulationFrontend::resize_framebuffers()
+{
+    // Only grows the storage when it's too small, so dragging the 
+    // window's edge rarely reallocates. The storage is trimmed back 
+    // once the size has stopped changing.
+    hdr_fbo->resize(window_width, window_height);
+
+    int width  = window_width / 2;
+    int height = window_height / 2;
+    for (auto level : bloom_chain) {
+        level->resize(std::max(width, 1), std::max(height, 1));
+        width  /= 2;
+        height /= 2;
+    }
+
+    last_resize_ticks = SDL_GetTicks();
+    trim_pending = true;
+}
+
+void SimulationFrontend::trim_framebuffers()
+{
+    constexpr Uint32 RESIZE_SETTLE_MS = 500;
+
+    if (!trim_pending || SDL_GetTicks() - last_resize_ticks < RESIZE_SETTLE_MS) {
+        return;
+    }
+
+    hdr_fbo->trim();
+    for (auto level : bloom_chain) {
+        level->trim();
+    }
+    trim_pending = false;
+}
+
+void SimulationFrontend::delete_framebuffers()
+{
+    delete hdr_fbo;
+    for (auto level : bloom_chain) {
+        delete level;
+    }
+    bloom_chain.clear();
 }
 
 void SimulationFrontend::init_vertex_buffers()
 {
-    line_vbo            = new GLVertexBuffer();
-    bodies_instance_vbo = new GLVertexBuffer();
-    sphere_vbo          = new GLVertexBuffer();
-    screen_vbo          = new GLVertexBuffer();
+    line_vbo     = new GLVertexBuffer();
+    sphere_vbo   = new GLVertexBuffer();
+    sphere_ibo   = new GLIndexBuffer();
+    impostor_vbo = new GLVertexBuffer();
+    screen_vbo   = new GLVertexBuffer();
+
+    for (auto& vbo : body_instance_vbos) {
+        vbo = new GLVertexBuffer();
+    }
 
     // Set the buffer data that doesn't change dynamically
-    sphere_vbo->set_data(SPHERE_MESH, GL_STATIC_DRAW);
+    sphere_vbo->set_data(SPHERE_VERTICES, GL_STATIC_DRAW);
+    sphere_ibo->set_data(SPHERE_INDICES, GL_STATIC_DRAW);
+    impostor_vbo->set_data(IMPOSTOR_MESH, GL_STATIC_DRAW);
     screen_vbo->set_data(SCREEN_MESH, GL_STATIC_DRAW);
+
+    camera_ubo = new GLUniformBuffer(sizeof(CameraBlock), CAMERA_BLOCK_BINDING);
+
+    // Clustered light lists, rebuilt every frame
+    light_data_tbo    = new GLTextureBuffer(GL_RGBA32F);
+    light_grid_tbo    = new GLTextureBuffer(GL_RG32UI);
+    light_indices_tbo = new GLTextureBuffer(GL_R32UI);
 }
 
 void SimulationFrontend::init_vertex_arrays()
 {
-    body_vao   = new GLVertexArray();
     line_vao   = new GLVertexArray();
     screen_vao = new GLVertexArray();
 
-    // Sphere mesh: only a position vec3 per vertex
-    body_vao->add_attrs(
-        *sphere_vbo,
-        VertexData{ 3, GL_FLOAT, GLVertexArray::Attr }
-    );
+    for (int lod = 0; lod < BodyLOD::NUM_BUCKETS; ++lod) {
+        auto vao = body_vaos[lod] = new GLVertexArray();
+
+        if (lod == BodyLOD::IMPOSTORS) {
+            // Impostor quad: only a corner vec2 per vertex
+            vao->add_attrs(
+                *impostor_vbo,
+                VertexData{ 2, GL_FLOAT, GLVertexArray::Attr }
+            );
+        } else {
+            // Sphere mesh: only a position vec3 per vertex
+            vao->add_attrs(
+                *sphere_vbo,
+                VertexData{ 3, GL_FLOAT, GLVertexArray::Attr }
+            );
+            vao->set_indices(*sphere_ibo);
+        }
 
-    // Body instances: a model mat4, a colour v3 and a light boolean 
-    body_vao->add_attrs(
-        *bodies_instance_vbo,
-        VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr },  // Model
-        VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr }, 
-        VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr },
-        VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr },
-        VertexData{ 3, GL_FLOAT, GLVertexArray::InstanceAttr },  // Colour
-        VertexData{ 1, GL_INT,   GLVertexArray::InstanceAttr }   // Emits light
-    );
+        // Body instances: a model mat4, a colour v3 and a light boolean 
+        vao->add_attrs(
+            *body_instance_vbos[lod],
+            VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr },  // Model
+            VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr }, 
+            VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr },
+            VertexData{ 4, GL_FLOAT, GLVertexArray::InstanceAttr },
+            VertexData{ 3, GL_FLOAT, GLVertexArray::InstanceAttr },  // Colour
+            VertexData{ 1, GL_INT,   GLVertexArray::InstanceAttr }   // Emits light
+        );
+    }
 
     // Tracer lines: only a position v3 per vertex
     line_vao->add_attrs(
@@ -122,25 +214,63 @@ void SimulationFrontend::init_vertex_arrays()
 
 void SimulationFrontend::init_shaders()
 {
-    line_shader  = new Shader("resources/line_vert.glsl",  
-                              "resources/line_frag.glsl");
-    body_shader  = new Shader("resources/body_vert.glsl",  
-                              "resources/body_frag.glsl");
-    bloom_shader = new Shader("resources/frame_vert.glsl", 
-                              "resources/bloom_frag.glsl");
+    // The world space shaders are prefixed with the camera block, and
+    // the body shaders share their lighting
+    line_shader     = new Shader({ "resources/camera.glsl",
+                                   "resources/line_vert.glsl" },
+                                 { "resources/line_frag.glsl" });
+    body_shader     = new Shader({ "resources/camera.glsl",
+                                   "resources/body_vert.glsl" },
+                                 { "resources/camera.glsl",
+                                   "resources/lighting.glsl",
+                                   "resources/body_frag.glsl" });
+    impostor_shader = new Shader({ "resources/camera.glsl",
+                                   "resources/impostor_vert.glsl" },
+                                 { "resources/camera.glsl",
+                                   "resources/lighting.glsl",
+                                   "resources/impostor_frag.glsl" });
+    bloom_down_shader = new Shader("resources/frame_vert.glsl", 
+                                   "resources/bloom_down_frag.glsl");
+    bloom_up_shader   = new Shader("resources/frame_vert.glsl", 
+                                   "resources/bloom_up_frag.glsl");
     final_shader = new Shader("resources/frame_vert.glsl", 
                               "resources/final_frag.glsl");
 
-    // Initialise the texture uniforms
-    bloom_shader->use();
-    bloom_shader->uniform_int("image", 0);
+    // Every shader reads the camera from the same uniform buffer
+    for (auto shader : { line_shader, body_shader, impostor_shader, 
+                         bloom_down_shader, bloom_up_shader, final_shader }) {
+        shader->bind_block("Camera", CAMERA_BLOCK_BINDING);
+    }
+
+    // Initialise the texture and constant uniforms
+    glm::ivec3 cluster_dims(
+        LightClusters::TILES_X, 
+        LightClusters::TILES_Y, 
+        LightClusters::SLICES);
+
+    for (auto shader : { body_shader, impostor_shader }) {
+        shader->use();
+        shader->uniform_int("light_data",    0);
+        shader->uniform_int("light_grid",    1);
+        shader->uniform_int("light_indices", 2);
+        shader->uniform_ivec3("cluster_dims", glm::value_ptr(cluster_dims));
+    }
+
+    bloom_down_shader->use();
+    bloom_down_shader->uniform_int("image", 0);
+
+    bloom_up_shader->use();
+    bloom_up_shader->uniform_int("image", 0);
 
     final_shader->use();
     final_shader->uniform_int("scene", 0);
     final_shader->uniform_int("bloom", 1);
+
+    gpu_trajectories = new GPUTrajectories(CAMERA_BLOCK_BINDING);
 }
 
-SimulationFrontend::SimulationFrontend()
+SimulationFrontend::SimulationFrontend(bool hidden)
+: offscreen(hidden)
 {
     init_graphics();
     init_framebuffers();
@@ -154,20 +284,29 @@ SimulationFrontend::SimulationFrontend()
 
 SimulationFrontend::~SimulationFrontend()
 {
-    delete hdr_fbo;
-    delete bloom_horizontal_fbo;
-    delete bloom_vertical_fbo;
+    delete_framebuffers();
     delete line_vbo;
-    delete bodies_instance_vbo;
     delete sphere_vbo;
+    delete sphere_ibo;
+    delete impostor_vbo;
     delete screen_vbo;
-    delete body_vao;
+    delete camera_ubo;
+    delete light_data_tbo;
+    delete light_grid_tbo;
+    delete light_indices_tbo;
+    for (int lod = 0; lod < BodyLOD::NUM_BUCKETS; ++lod) {
+        delete body_instance_vbos[lod];
+        delete body_vaos[lod];
+    }
     delete line_vao;
     delete screen_vao;
     delete line_shader;
     delete body_shader;
-    delete bloom_shader;
+    delete impostor_shader;
+    delete bloom_down_shader;
+    delete bloom_up_shader;
     delete final_shader;  
+    delete gpu_trajectories;
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
@@ -207,13 +346,25 @@ void SimulationFrontend::handle_events()
             break;
         case SDL_MOUSEBUTTONDOWN:
             holding = true;
+            // Dragging with shift held selects a rectangle of bodies
+            // instead of rotating the camera
+            if ((SDL_GetModState() & KMOD_SHIFT) 
+                && !ImGui::GetIO().WantCaptureMouse) {
+                selecting = true;
+                select_start_x = event.button.x;
+                select_start_y = event.button.y;
+            }
             break;
         case SDL_MOUSEBUTTONUP:
             holding = false;
-            // If the mouse was held for few 
-            // enough frames, treat it as a click
-            if (mouse_held_time < MAX_CLICK_TIME)
+            if (selecting) {
+                selecting = false;
+                selection_done = true;
+            } else if (mouse_held_time < MAX_CLICK_TIME) {
+                // If the mouse was held for few 
+                // enough frames, treat it as a click
                 mouse_clicked = true;
+            }
             mouse_held_time = 0;
             break;
         case SDL_WINDOWEVENT:
@@ -223,10 +374,7 @@ void SimulationFrontend::handle_events()
                 window_width = event.window.data1;
                 window_height = event.window.data2;
                 update_viewport();
-                delete hdr_fbo;
-                delete bloom_horizontal_fbo;
-                delete bloom_vertical_fbo;
-                init_framebuffers();
+                resize_framebuffers();
             }
             break;
         }
@@ -250,7 +398,7 @@ void SimulationFrontend::handle_mouse_input()
 
         // If the mouse is not on the UI, rotate the 
         // camera based on the mouse dragging
-        if (!io.WantCaptureMouse) {
+        if (!io.WantCaptureMouse && !selecting) {
             cam_angle_y += (mouse_x - prev_mouse_x) * CAMERA_ROT_COEFF;
             cam_angle_x += (mouse_y - prev_mouse_y) * CAMERA_ROT_COEFF;
             cam_angle_x = std::clamp(cam_angle_x, MIN_X_ANGLE, MAX_X_ANGLE);
@@ -259,6 +407,11 @@ void SimulationFrontend::handle_mouse_input()
     prev_mouse_x = mouse_x;
     prev_mouse_y = mouse_y;
 
+    if (selection_done) {
+        selection_done = false;
+        select_bodies_in_rect(select_start_x, select_start_y, mouse_x, mouse_y);
+    }
+
     if (mouse_clicked && !io.WantCaptureMouse) {
         // Begin tracking the body behind the mouse cursor.
         // Convert the mouse position to NDC
@@ -268,30 +421,45 @@ void SimulationFrontend::handle_mouse_input()
         // Un-apply the transformation matrices 
         // to get the mouse position in world space
         auto click_pos_clip     = glm::vec4(x, y, -1.0f, 1.0f);
-        auto click_pos_eye      = glm::inverse(projection) * click_pos_clip;
+        auto click_pos_eye      = inverse_projection * click_pos_clip;
         auto click_pos_eye_back = glm::vec4(click_pos_eye.xy(), -1.0f, 0.0f);
-        auto click_pos_world    = glm::inverse(view) * click_pos_eye_back;
+        auto click_pos_world    = inverse_view * click_pos_eye_back;
 
         // Normalising will give us a ray towards the pixel
-        float dist = INFINITY;
         auto ray = glm::normalize(click_pos_world.xyz());
-        tracked_body = Simulation::NO_BODY;
-
-        for (int i = 0; i < simulation.num_bodies; ++i) {
-            auto pos    = simulation.get_physics(i).position;
-            auto radius = simulation.get_physics(i).radius;
-
-            // Compute the ray-sphere intersection
-            auto a = (cam_pos - pos);
-            auto b = glm::dot(a, ray);
-            auto c = glm::dot(a, a) - radius * radius;
-            auto d = glm::length(a);
+        int index = body_bvh.pick(simulation, cam_pos, ray);
+        tracked_body = simulation.handle_of(index);
+    }
+}
 
-            if (b * b - c >= 0 && d < dist) {
-                tracked_body = i;
-                dist = d;
-            }
-        }
+void SimulationFrontend::select_bodies_in_rect(int x0, int y0, int x1, int y1)
+{
+    // Convert the corners to NDC
+    float left   = (2.0f * std::min(x0, x1)) / window_width - 1.0f;
+    float right  = (2.0f * std::max(x0, x1)) / window_width - 1.0f;
+    float top    = 1.0f - (2.0f * std::min(y0, y1)) / window_height;
+    float bottom = 1.0f - (2.0f * std::max(y0, y1)) / window_height;
+
+    // Planes of the frustum through the rectangle, taken from the rows
+    // of the view projection matrix (a point is inside when e.g. 
+    // clip.x >= left * clip.w). Rows are read across glm's columns.
+    auto vp  = projection * view;
+    auto row = [&](int i) {
+        return glm::vec4(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+    };
+    std::array<glm::vec4, 5> planes = {
+        row(0) - left   * row(3),
+        right  * row(3) - row(0),
+        row(1) - bottom * row(3),
+        top    * row(3) - row(1),
+        row(2) + row(3)
+    };
+
+    body_bvh.select(simulation, planes, selection_scratch);
+
+    selected_bodies.clear();
+    for (int index : selection_scratch) {
+        selected_bodies.push_back(simulation.handle_of(index));
     }
 }
 
@@ -317,18 +485,16 @@ void SimulationFrontend::update_camera()
     // Calculate the camera position and view matrix
     cam_pos = tracked_pos + cam_dir * cam_dist;
     view = glm::lookAt(cam_pos, tracked_pos, UP);
+    inverse_view = glm::inverse(view);
 }
 
 void SimulationFrontend::update_viewport()
 {
-    constexpr float FOV       = glm::radians(45.0f);
-    constexpr float NEAR_CLIP = .1f;
-    constexpr float FAR_CLIP  = 10000.0f;
-
     float aspect_ratio = (float) window_width / (float) window_height;
 
     // Calculate the projection matrix and update the viewport
     projection = glm::perspective(FOV, aspect_ratio, NEAR_CLIP, FAR_CLIP);
+    inverse_projection = glm::inverse(projection);
     glViewport(0, 0, window_width, window_height);
 }
 
@@ -338,8 +504,14 @@ void SimulationFrontend::run()
     while (running) {
         handle_events();
         handle_mouse_input();
+        trim_framebuffers();
 
         simulation.update();
+        if (simulation.state == SimulationState::Running
+            && simulation.num_updates % snapshot_period == 0) {
+            snapshots.take(simulation);
+        }
+        body_bvh.update(simulation);
 
         update_camera();
         render_scene();
@@ -353,3 +525,62 @@ void SimulationFrontend::run()
     SDL_Quit();
 }
 
+int SimulationFrontend::run_export(const ExportOptions& options)
+{
+    if (!options.load_path.empty()) {
+        simulation.load_simulation(options.load_path);
+    }
+    if (options.scene) {
+        generate_scene(simulation, *options.scene);
+    }
+    if (options.distance > 0.0f) {
+        cam_dist = options.distance;
+    }
+
+    // Render at the export resolution, whatever the window's size
+    window_width  = options.width;
+    window_height = options.height;
+    update_viewport();
+    delete_framebuffers();
+    init_framebuffers();
+
+    output_fbo = new GLFrameBuffer(window_width, window_height);
+    output_fbo->attach_textures(1, GL_RGBA8);
+    output_fbo->check();
+
+    FrameExporter exporter(window_width, window_height, options.target);
+    simulation.state = SimulationState::Running;
+
+    for (int frame = 0; frame < options.frames && exporter.ok(); ++frame) {
+        // Nothing is shown, but the window system still expects 
+        // its events to be handled
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                running = false;
+            }
+        }
+        if (!running) {
+            break;
+        }
+
+        for (int step = 0; step < options.steps_per_frame; ++step) {
+            simulation.update();
+        }
+
+        update_camera();
+        render_scene();
+        exporter.capture();
+
+        if ((frame + 1) % 100 == 0) {
+            std::cout << "Rendered " << frame + 1 << " frames\n";
+        }
+    }
+
+    exporter.finish();
+    delete output_fbo;
+    output_fbo = nullptr;
+
+    std::cout << "Exported " << exporter.frames_written() << " frames\n";
+    return exporter.ok() ? 0 : 1;
+}
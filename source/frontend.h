@@ -18,9 +18,48 @@
 #include "shader.h"
 #include "gl_objects.h"
 #include "simulation.h"
+#include "scene_generators.h"
+#include "body_list.h"
+#include "picking.h"
+#include "light_clusters.h"
+#include "body_lod.h"
+#include "frame_exporter.h"
+#include "gpu_trajectories.h"
+#include "file_task.h"
+#include "snapshot_store.h"
+#include "tracer_buffer.h"
 
-constexpr std::array SPHERE_MESH = {
-#include "../resources/spheremesh.txt"
+// Indexed sphere meshes at several levels of detail, generated by
+// scripts/sphere_generator.py. Every level shares one vertex and one
+// index buffer, and each one's indices start from its base vertex.
+struct MeshRange {
+    unsigned first_index;
+    unsigned index_count;
+    int base_vertex;
+};
+
+constexpr std::array SPHERE_VERTICES = {
+#include "../resources/spheremesh_vertices.txt"
+};
+
+constexpr auto SPHERE_INDICES = std::to_array<unsigned short>({
+#include "../resources/spheremesh_indices.txt"
+});
+
+constexpr std::array SPHERE_LODS = {
+#include "../resources/spheremesh_lods.txt"
+};
+
+static_assert(SPHERE_LODS.size() == BodyLOD::NUM_MESHES);
+
+// Corners of the quad that body impostors are drawn on
+constexpr std::array IMPOSTOR_MESH = {
+    -1.0f, -1.0f,
+     1.0f, -1.0f,
+     1.0f,  1.0f,
+    -1.0f, -1.0f,
+     1.0f,  1.0f,
+    -1.0f,  1.0f
 };
 
 constexpr std::array SCREEN_MESH = {
@@ -33,7 +72,38 @@ constexpr std::array SCREEN_MESH = {
      1.0f,  1.0f,   1.0f, 1.0f
 };
 
-constexpr unsigned SPHERE_VERTEX_COUNT = SPHERE_MESH.size() / 3;
+constexpr float FOV       = glm::radians(45.0f);
+constexpr float NEAR_CLIP = .1f;
+constexpr float FAR_CLIP  = 10000.0f;
+
+// Per-frame camera state, shared by every shader that declares the
+// Camera uniform block. Laid out to match std140, so vec3s are padded.
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 camera_pos;     // xyz, w unused
+    glm::vec2 screen_size;
+    float near_clip;
+    float far_clip;
+};
+
+static_assert(sizeof(CameraBlock) == 160, "CameraBlock must match std140");
+
+constexpr unsigned CAMERA_BLOCK_BINDING = 0;
+
+enum class BloomQuality {
+    Off, Low, Medium, High
+};
+
+constexpr const char *BLOOM_QUALITY_NAMES[] = {
+    "off", "low", "medium", "high"
+};
+
+// Number of times the emitters are halved in size for each quality.
+// More levels spread the glow further.
+constexpr int BLOOM_LEVELS[] = { 0, 3, 5, 7 };
+
+constexpr unsigned IMPOSTOR_VERTEX_COUNT = IMPOSTOR_MESH.size() / 2;
 
 constexpr unsigned SCREEN_VERTEX_COUNT = SCREEN_MESH.size() / 4;
 
@@ -43,30 +113,59 @@ class SimulationFrontend {
     int window_height = 1000;
     SDL_Window *window;
     SDL_GLContext context;
+    Uint32 last_resize_ticks = 0;
+    bool trim_pending = false;
+    bool offscreen;     // Hidden window, for exporting frames
 
     // Rendering
     GLFrameBuffer *hdr_fbo;
-    GLFrameBuffer *bloom_horizontal_fbo;
-    GLFrameBuffer *bloom_vertical_fbo;
+    // Where the final image goes, or the window if null
+    GLFrameBuffer *output_fbo = nullptr;
+    // Each level is half the size of the one before, 
+    // starting at half the window size
+    std::vector<GLFrameBuffer*> bloom_chain;
+    BloomQuality bloom_quality = BloomQuality::Medium;
 
     GLVertexBuffer *line_vbo;
-    GLVertexBuffer *bodies_instance_vbo;
     GLVertexBuffer *sphere_vbo;
+    GLIndexBuffer  *sphere_ibo;
+    GLVertexBuffer *impostor_vbo;
     GLVertexBuffer *screen_vbo;
 
-    GLVertexArray *body_vao;
+    GLUniformBuffer *camera_ubo;
+
+    GLTextureBuffer *light_data_tbo;
+    GLTextureBuffer *light_grid_tbo;
+    GLTextureBuffer *light_indices_tbo;
+
+    // One instance buffer and vertex array per level of detail
+    std::array<GLVertexBuffer*, BodyLOD::NUM_BUCKETS> body_instance_vbos;
+    std::array<GLVertexArray*,  BodyLOD::NUM_BUCKETS> body_vaos;
     GLVertexArray *line_vao;
     GLVertexArray *screen_vao;
 
     Shader *line_shader;
     Shader *body_shader;
-    Shader *bloom_shader;
+    Shader *impostor_shader;
+    Shader *bloom_down_shader;
+    Shader *bloom_up_shader;
     Shader *final_shader;
 
     glm::mat4 projection;
     glm::mat4 view;
+    glm::mat4 inverse_projection;
+    glm::mat4 inverse_view;
 
-    int tracked_body = Simulation::NO_BODY;
+    GPUTrajectories *gpu_trajectories;
+    bool use_gpu_trajectories = false;
+    // The CPU's tracers, packed into line_vbo
+    TracerBuffer tracer_buffer;
+
+    BodyLOD body_lod;
+    LightClusters light_clusters;
+    float light_range = 2000.0f;
+
+    BodyHandle tracked_body = Simulation::NO_BODY;
     bool render_tracers = true;
 
     // Camera 
@@ -83,27 +182,51 @@ class SimulationFrontend {
     int mouse_held_time = 0;
     bool mouse_clicked = false;
 
+    // Rectangle selection, by dragging with shift held
+    bool selecting = false;
+    bool selection_done = false;
+    int select_start_x = 0;
+    int select_start_y = 0;
+    std::vector<BodyHandle> selected_bodies;
+    std::vector<int> selection_scratch;
+    BodyBVH body_bvh;
+
     // Simulation
     Simulation simulation;
+    // The load or save in progress, if any
+    std::unique_ptr<SimulationFileTask> file_task;
+    // Taken every snapshot_period updates while running
+    SnapshotStore snapshots;
+    int snapshot_period = 100;
+    int selected_snapshot = -1;
 
     // UI
     BodyPhysics  prototype_physics;
-    BodyInfo     prototype_info { "Body", {} };
+    std::string  prototype_name = "Body";
     BodyInstance prototype_instance {
         glm::mat4(1.0f),
         glm::vec3(1.0f, 0.5f, 0.31f),
         0
     };
+    SceneParameters scene_parameters;
+    std::string tracked_name;   // Edit buffer for the tracked body's name
+    BodyList    body_list;      // Shared by the body pickers
 
 public:
-    SimulationFrontend();
+    SimulationFrontend(bool hidden = false);
     ~SimulationFrontend();
     void run();
+    // Render frames into an offscreen framebuffer and export them
+    int run_export(const ExportOptions& options);
 
 private:
     // Initialisation
     void init_graphics();
     void init_framebuffers();
+    void init_bloom_chain();
+    void resize_framebuffers();
+    void trim_framebuffers();
+    void delete_framebuffers();
     void init_vertex_buffers();
     void init_vertex_arrays();
     void init_shaders();
@@ -111,6 +234,7 @@ private:
     // Updating
     void handle_events();
     void handle_mouse_input();
+    void select_bodies_in_rect(int x0, int y0, int x1, int y1);
     void update_viewport();
     void update_camera();
 
@@ -123,8 +247,16 @@ private:
     // GUI
     void ui_state_switching();
     void ui_body_selection();
+    void ui_body_list_options();
     void ui_state_specifics();
+    void ui_trajectory_options();
+    void ui_integrator_options();
+    void ui_render_options();
+    void ui_scene_generation();
+    void ui_selection();
     void ui_saving_loading();
+    void ui_snapshots();
+    void ui_file_task();
     void show_ui();
 };
 
@@ -2,6 +2,7 @@
  * 
  */
 #include "frontend.h"
+#include "catalogue.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui_impl_sdl.h>
@@ -9,7 +10,10 @@
 #include <misc/cpp/imgui_stdlib.h>
 #include <ImGuiFileDialog.h>
 
-static void ui_body_editing(BodyInfo&     info, 
+#include <cstdio>
+
+// Returns whether the name was edited
+static bool ui_body_editing(std::string&  name, 
                             BodyPhysics&  physics, 
                             BodyInstance& instance)
 {
@@ -40,7 +44,7 @@ static void ui_body_editing(BodyInfo&     info,
         scalar_input(comp2, &v->z);
     };
 
-    ImGui::InputText("name", &info.name);
+    bool renamed = ImGui::InputText("name", &name);
 
     // Physics options
     if (ImGui::CollapsingHeader("Physics")) {
@@ -74,6 +78,8 @@ static void ui_body_editing(BodyInfo&     info,
 
     physics.position = physics.orig_position;
     physics.velocity = physics.orig_velocity;
+
+    return renamed;
 }
 
 void SimulationFrontend::ui_state_switching()
@@ -113,15 +119,15 @@ void SimulationFrontend::ui_body_selection()
             ImGui::OpenPopup(text);
         }
 
-        // Name display
+        // Name display. Names are null terminated, 
+        // so they can be drawn without copying.
         ImGui::SameLine();
-        std::string selected_body_name = simulation
-            .get_info(selected_body)
-            .name;
-        ImGui::Text(selected_body_name.c_str());
+        ImGui::TextUnformatted(simulation.get_info(selected_body).name.data());
 
         // Draw a selectable box for each body as well as one for no body
         if (ImGui::BeginPopup(text)) {
+            ui_body_list_options();
+
             if (ImGui::Selectable("NONE")) {
                 selected_body = Simulation::NO_BODY;
                 if (clear) {
@@ -129,21 +135,36 @@ void SimulationFrontend::ui_body_selection()
                 }
             }
 
-            for (int i = 0; i < simulation.num_bodies; ++i) {
-                auto name = simulation.body_info[i].name; 
-                if (i == selected_body) {
-                    name = "<" + name + ">";
-                }
-                name += "##" + std::to_string(i); // Make unique
-                if (ImGui::Selectable(name.c_str())) {
-                    selected_body = i;
-                    // Switching relative body means the
-                    // tracers should be cleared
-                    if (clear) {
-                        simulation.clear_tracers();
+            // Only the rows scrolled into view are submitted, and
+            // pushing the index as the ID keeps duplicate names unique
+            constexpr int MAX_VISIBLE_ROWS = 20;
+            const auto& rows = body_list.rows();
+            float row_height = ImGui::GetTextLineHeightWithSpacing();
+            int num_rows = std::min<int>(rows.size(), MAX_VISIBLE_ROWS);
+
+            ImGui::BeginChild("bodies", ImVec2(300.0f, num_rows * row_height));
+            ImGuiListClipper clipper;
+            clipper.Begin(rows.size(), row_height);
+
+            while (clipper.Step()) {
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+                    int i = rows[row];
+                    auto handle = simulation.handle_of(i);
+                    const char *name = simulation.get_info(i).name.data();
+
+                    ImGui::PushID(i);
+                    if (ImGui::Selectable(name, handle == selected_body)) {
+                        selected_body = handle;
+                        // Switching relative body means the
+                        // tracers should be cleared
+                        if (clear) {
+                            simulation.clear_tracers();
+                        }
                     }
+                    ImGui::PopID();
                 }
             }
+            ImGui::EndChild();
             ImGui::EndPopup();
         }
     };
@@ -158,6 +179,41 @@ void SimulationFrontend::ui_body_selection()
         true);
 }
 
+void SimulationFrontend::ui_body_list_options()
+{
+    // Filtering and sorting for the body picker. The list caches its
+    // results, so this is cheap unless something changed.
+    ImGui::InputText("filter", &body_list.filter);
+    ImGui::SameLine();
+    ImGui::Checkbox("regex", &body_list.use_regex);
+
+    int key = static_cast<int>(body_list.sort_key);
+    ImGui::SetNextItemWidth(120.0f);
+    ImGui::Combo("sort by", &key, BODY_SORT_KEY_NAMES, 
+                 IM_ARRAYSIZE(BODY_SORT_KEY_NAMES));
+    body_list.sort_key = static_cast<BodySortKey>(key);
+
+    ImGui::SameLine();
+    ImGui::Checkbox("descending", &body_list.descending);
+    ImGui::SameLine();
+    // Distances and speeds change as the simulation runs
+    if (ImGui::Button("Refresh")) {
+        body_list.resort();
+    }
+
+    // Distances are measured from the body being tracked
+    auto origin = simulation.get_physics(tracked_body).position;
+    body_list.refresh(simulation, origin);
+
+    if (body_list.bad_pattern()) {
+        ImGui::Text("Invalid pattern");
+    } else if (body_list.searching()) {
+        ImGui::Text("Searching... %zu matches", body_list.rows().size());
+    } else {
+        ImGui::Text("%zu matches", body_list.rows().size());
+    }
+}
+
 void SimulationFrontend::ui_state_specifics()
 {
     // State specific options
@@ -168,29 +224,39 @@ void SimulationFrontend::ui_state_specifics()
         }
         if (ImGui::BeginPopup("body_add")) {
             // Editing for a new body to be added
-            ui_body_editing(prototype_info, prototype_physics, prototype_instance);
-
-            if (ImGui::Button("Add") && prototype_info.name.size() > 0) {
-                simulation.body_info.push_back(prototype_info);
-                simulation.body_physics.push_back(prototype_physics);
-                simulation.body_instance.push_back(prototype_instance);
+            ui_body_editing(prototype_name, prototype_physics, prototype_instance);
 
-                tracked_body = simulation.num_bodies;
-                simulation.num_bodies++;
+            if (ImGui::Button("Add") && prototype_name.size() > 0) {
+                tracked_body = simulation.add_body(
+                    BodyInfo{ prototype_name, {} }, 
+                    prototype_physics, 
+                    prototype_instance);
                 ImGui::CloseCurrentPopup();
             }
             ImGui::EndPopup();
         }
 
+        ui_scene_generation();
+
         ImGui::Checkbox("Show trajectories", &render_tracers);
+        ImGui::Checkbox("Compute trajectories on GPU", &use_gpu_trajectories);
+        ui_trajectory_options();
+        ui_integrator_options();
+        ui_render_options();
 
         // Current Body options
-        if (tracked_body != Simulation::NO_BODY) {
+        int tracked_index = simulation.index_of(tracked_body);
+        if (tracked_index != Simulation::NO_INDEX) {
             ImGui::Text("Selected body:");
-            auto& info = simulation.body_info[tracked_body];
-            auto& phys = simulation.body_physics[tracked_body];
-            auto& inst = simulation.body_instance[tracked_body];
-            ui_body_editing(info, phys, inst);
+            auto& phys = simulation.body_physics[tracked_index];
+            auto& inst = simulation.body_instance[tracked_index];
+
+            // Edit a copy of the name, as names live in the simulation's
+            // arena. Assigning reuses the buffer's storage.
+            tracked_name = simulation.get_info(tracked_index).name;
+            if (ui_body_editing(tracked_name, phys, inst)) {
+                simulation.set_name(tracked_index, tracked_name);
+            }
 
             if (ImGui::Button("Draw relative to body")) {
                 simulation.draw_tracers_relative_to = tracked_body;
@@ -205,6 +271,123 @@ void SimulationFrontend::ui_state_specifics()
         ui_saving_loading();
     } else {
         ImGui::Checkbox("Show trails", &render_tracers);
+        ui_render_options();
+    }
+
+    ui_snapshots();
+}
+
+void SimulationFrontend::ui_trajectory_options()
+{
+    // Longer previews are extended over several frames, 
+    // spending at most the budget on them each frame
+    auto& settings = simulation.trajectory_settings;
+    ImGui::SliderInt("preview steps", &settings.horizon, 100, 100000, 
+                     "%d", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderInt("steps per point", &settings.period, 1, 100);
+    ImGui::SliderFloat("preview budget (ms)", 
+                       &simulation.trajectory_budget_ms, 0.0f, 16.0f, "%.1f");
+
+    settings.horizon = std::max(settings.horizon, 1);
+    settings.period  = std::max(settings.period, 1);
+}
+
+void SimulationFrontend::ui_integrator_options()
+{
+    auto& settings = simulation.integrator_settings;
+    int type = static_cast<int>(settings.type);
+    if (ImGui::Combo("integrator", &type, INTEGRATOR_NAMES, 
+                     IM_ARRAYSIZE(INTEGRATOR_NAMES))) {
+        settings.type = static_cast<IntegratorType>(type);
+    }
+    // Wisdom-Holman steps can be far longer on star dominated systems
+    ImGui::SliderFloat("time step", &settings.time_step, 0.01f, 100.0f, 
+                       "%.2f", ImGuiSliderFlags_Logarithmic);
+    settings.time_step = std::max(settings.time_step, 0.001f);
+
+    if (settings.type == IntegratorType::Automatic) {
+        int central = simulation.integrator_central_body();
+        if (central == Simulation::NO_INDEX) {
+            ImGui::Text("Using euler, no dominant body");
+        } else {
+            ImGui::Text("Using wisdom-holman around %s", 
+                        simulation.get_info(central).name.data());
+        }
+    }
+}
+
+void SimulationFrontend::ui_render_options()
+{
+    ImGui::SliderFloat("light range", &light_range, 1.0f, FAR_CLIP, 
+                       "%.0f", ImGuiSliderFlags_Logarithmic);
+
+    int quality = static_cast<int>(bloom_quality);
+    if (ImGui::Combo("bloom", &quality, BLOOM_QUALITY_NAMES, 
+                     IM_ARRAYSIZE(BLOOM_QUALITY_NAMES))) {
+        bloom_quality = static_cast<BloomQuality>(quality);
+        delete_framebuffers();
+        init_framebuffers();
+    }
+}
+
+void SimulationFrontend::ui_selection()
+{
+    // Bodies selected by dragging a rectangle with shift held. 
+    // Forget any that have been deleted since.
+    std::erase_if(selected_bodies, [&](BodyHandle handle) {
+        return simulation.index_of(handle) == Simulation::NO_INDEX;
+    });
+
+    if (selecting) {
+        int mouse_x, mouse_y;
+        SDL_GetMouseState(&mouse_x, &mouse_y);
+        ImGui::GetForegroundDrawList()->AddRect(
+            ImVec2(select_start_x, select_start_y),
+            ImVec2(mouse_x, mouse_y),
+            IM_COL32(255, 255, 255, 200));
+    }
+
+    if (selected_bodies.empty()) {
+        return;
+    }
+
+    ImGui::Text("%zu bodies selected", selected_bodies.size());
+    if (simulation.state == SimulationState::Waiting) {
+        if (ImGui::Button("Delete selected")) {
+            simulation.delete_bodies(selected_bodies);
+            selected_bodies.clear();
+        }
+        ImGui::SameLine();
+    }
+    if (ImGui::Button("Clear selection")) {
+        selected_bodies.clear();
+    }
+}
+
+void SimulationFrontend::ui_scene_generation()
+{
+    // Procedurally generate a large scene and add it to the simulation
+    if (ImGui::Button("Generate scene")) {
+        ImGui::OpenPopup("scene_generate");
+    }
+    if (ImGui::BeginPopup("scene_generate")) {
+        auto& params = scene_parameters;
+        int type = static_cast<int>(params.type);
+        ImGui::Combo("type", &type, SCENE_TYPE_NAMES, 
+                     IM_ARRAYSIZE(SCENE_TYPE_NAMES));
+        params.type = static_cast<SceneType>(type);
+
+        ImGui::InputInt("bodies", &params.count, 1000, 10000);
+        ImGui::InputScalar("seed", ImGuiDataType_U64, &params.seed);
+        ImGui::InputFloat("scale", &params.scale, 1.0f, 10.0f);
+        ImGui::InputFloat("mass", &params.mass, 10.0f, 100.0f);
+        params.count = std::max(params.count, 1);
+
+        if (ImGui::Button("Generate")) {
+            generate_scene(simulation, params);
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
     }
 }
 
@@ -212,10 +395,11 @@ void SimulationFrontend::ui_saving_loading()
 {
     auto *file_dialog = ImGuiFileDialog::Instance();
 
-    auto handle_file = [&](const std::string &name, auto &&action) {
+    auto handle_file = [&](const std::string &name, const char *filters, 
+                           auto &&action) {
         std::string toggle = name + "##Toggle";
         if (ImGui::Button(toggle.c_str())) {
-            file_dialog->OpenDialog(name, name, ".sim", ".");
+            file_dialog->OpenDialog(name, name, filters, ".");
         }
 
         if (file_dialog->Display(name)) {
@@ -228,12 +412,128 @@ void SimulationFrontend::ui_saving_loading()
     };
 
     if (ImGui::CollapsingHeader("Manage Simulation")) {
-        handle_file("Load Simulation", [&](auto s) { 
-            simulation.load_simulation(s);
+        // Only one file is read or written at a time
+        handle_file("Load Simulation", ".sim", [&](auto s) { 
+            if (!file_task) {
+                file_task = std::make_unique<SimulationFileTask>(s);
+            }
         });
-        handle_file("Save Simulation", [&](auto s) { 
-            simulation.save_simulation(s); 
+        handle_file("Save Simulation", ".sim", [&](auto s) { 
+            if (!file_task) {
+                file_task = std::make_unique<SimulationFileTask>(s, simulation.snapshot());
+            }
         });
+        // Adds the bodies, with the default columns
+        handle_file("Import Catalogue", ".csv,.txt,.dat", [&](auto s) {
+            if (!file_task) {
+                CatalogueOptions options;
+                options.path = s;
+                options.first_index = simulation.num_bodies;
+                file_task = std::make_unique<SimulationFileTask>(options);
+            }
+        });
+    }
+}
+
+void SimulationFrontend::ui_snapshots()
+{
+    if (!ImGui::CollapsingHeader("Snapshots")) {
+        return;
+    }
+
+    ImGui::SliderInt("updates per snapshot", &snapshot_period, 1, 10000,
+                     "%d", ImGuiSliderFlags_Logarithmic);
+    snapshot_period = std::max(snapshot_period, 1);
+    int budget_mb = snapshots.budget() >> 20;
+    if (ImGui::SliderInt("snapshot budget (MB)", &budget_mb, 16, 8192,
+                         "%d", ImGuiSliderFlags_Logarithmic)) {
+        snapshots.set_budget(size_t(std::max(budget_mb, 1)) << 20);
+    }
+    ImGui::Text("%d snapshots, %.1f MB", snapshots.size(), 
+                snapshots.memory_used() / float(1 << 20));
+
+    if (snapshots.size() == 0) {
+        return;
+    }
+
+    // The oldest are dropped as the run goes on, so the
+    // selection can point past the end
+    selected_snapshot = std::min(selected_snapshot, snapshots.size() - 1);
+
+    constexpr int MAX_VISIBLE_ROWS = 10;
+    float row_height = ImGui::GetTextLineHeightWithSpacing();
+    int num_rows = std::min(snapshots.size(), MAX_VISIBLE_ROWS);
+
+    ImGui::BeginChild("snapshots", ImVec2(300.0f, num_rows * row_height));
+    ImGuiListClipper clipper;
+    clipper.Begin(snapshots.size(), row_height);
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+            // Formatted on the stack, so drawing the list doesn't allocate
+            auto info = snapshots.info(i);
+            char label[64];
+            std::snprintf(label, sizeof(label), "Update %d, %d bodies", 
+                          info.num_updates, info.num_bodies);
+            ImGui::PushID(i);
+            if (ImGui::Selectable(label, i == selected_snapshot)) {
+                selected_snapshot = i;
+            }
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndChild();
+
+    if (selected_snapshot < 0) {
+        return;
+    }
+    // Rewinding carries on in the same state. Forking starts a 
+    // new run from the snapshot, for the bodies to be edited first.
+    bool rewind = ImGui::Button("Rewind");
+    ImGui::SameLine();
+    bool fork = ImGui::Button("Fork");
+    if (rewind || fork) {
+        if (rewind) {
+            snapshots.rewind(selected_snapshot, simulation);
+            // Waiting would put the bodies back at their start
+            if (simulation.state == SimulationState::Waiting) {
+                simulation.state = SimulationState::Paused;
+            }
+        } else {
+            snapshots.fork(selected_snapshot, simulation);
+        }
+        tracked_body = Simulation::NO_BODY;
+        selected_bodies.clear();
+    }
+}
+
+void SimulationFrontend::ui_file_task()
+{
+    if (!file_task) {
+        return;
+    }
+
+    if (file_task->done()) {
+        // The loaded bodies are moved in, rather than copied, 
+        // so even a large scene only stalls a frame briefly
+        auto kind = file_task->kind();
+        if (kind == FileTaskKind::Load && file_task->succeeded()) {
+            simulation.restore(std::move(file_task->result()));
+            tracked_body = Simulation::NO_BODY;
+            selected_bodies.clear();
+        } else if (kind == FileTaskKind::Import && file_task->succeeded()) {
+            simulation.append_snapshot(file_task->result());
+        }
+        file_task.reset();
+        return;
+    }
+
+    constexpr const char *ACTIONS[] = { "Loading", "Saving", "Importing" };
+    const char *action = ACTIONS[int(file_task->kind())];
+    ImGui::Text("%s %s", action, file_task->path().c_str());
+    ImGui::ProgressBar(file_task->progress());
+    if (ImGui::Button("Cancel##FileTask")) {
+        // Waits for the task to notice, which is at most one block
+        file_task.reset();
     }
 }
 
@@ -245,7 +545,9 @@ void SimulationFrontend::show_ui()
     ImGui::Begin("Options");
 
     ui_state_switching();
+    ui_file_task();
     ui_body_selection();
+    ui_selection();
     ui_state_specifics();
     
     ImGui::End();
@@ -4,86 +4,136 @@
 
 void SimulationFrontend::draw_tracers()
 {
+    // Previews of the trajectories can be computed on the GPU, 
+    // straight into the buffer they're drawn from. It only has
+    // the Euler integrator, so Wisdom-Holman scenes stay on the CPU.
+    bool gpu_integrator = simulation.integrator_central_body() == Simulation::NO_INDEX;
+    simulation.compute_trajectories = !(use_gpu_trajectories && gpu_integrator);
+    bool gpu_previews = use_gpu_trajectories && gpu_integrator
+                     && simulation.state == SimulationState::Waiting;
+
+    if (gpu_previews) {
+        if (render_tracers) {
+            gpu_trajectories->compute(simulation);
+            gpu_trajectories->draw(simulation);
+        }
+        return;
+    }
+
     if (render_tracers) {
+        auto origin = simulation.tracer_origin();
         line_shader->use();
-        line_shader->uniform_mat4("projection", glm::value_ptr(projection));
-        line_shader->uniform_mat4("view", glm::value_ptr(view));
-
+        line_shader->uniform_vec3("origin", glm::value_ptr(origin));
+        tracer_buffer.update(simulation, *line_vbo);
         line_vao->use();
-        for (int i = 0; i < simulation.num_bodies; ++i) {
-            auto& tracers = simulation.get_info(i).tracers;
-            line_vbo->set_data(tracers, GL_DYNAMIC_DRAW);
-            glDrawArrays(GL_LINES, 0, tracers.size());
-        }
+        tracer_buffer.draw();
     }
 }
 
 void SimulationFrontend::draw_bodies()
 {
-    // Send the matrices to the GPU
-    body_shader->use();
-    body_shader->uniform_mat4("projection", glm::value_ptr(projection));
-    body_shader->uniform_mat4("view",       glm::value_ptr(view));
-    body_shader->uniform_vec3("camera_pos", glm::value_ptr(cam_pos));
-
-    // Update the shader light sources
-    static const auto set_light_param = 
-    [&](int num, std::string field, glm::vec3 value) {
-        auto name = "lights[" + std::to_string(num) + "]." + field;
-        body_shader->uniform_vec3(name.c_str(), glm::value_ptr(value));
-    };
-
-    int num_lights = 0;
-
-    for (int i = 0; i < simulation.num_bodies; ++i) {
-        const auto& instance = simulation.get_instance(i);
-        const auto& physics  = simulation.get_physics(i);
+    // Bin the light sources into clusters and upload them, 
+    // so that each fragment only shades the nearby lights
+    light_clusters.build(
+        simulation, view, projection, NEAR_CLIP, FAR_CLIP, light_range);
+
+    light_data_tbo->set_data(light_clusters.lights, GL_STREAM_DRAW);
+    light_grid_tbo->set_data(light_clusters.grid, GL_STREAM_DRAW);
+    light_indices_tbo->set_data(light_clusters.indices, GL_STREAM_DRAW);
+    light_data_tbo->use(GL_TEXTURE0);
+    light_grid_tbo->use(GL_TEXTURE1);
+    light_indices_tbo->use(GL_TEXTURE2);
+
+    // Cull the bodies outside the view, then pick a mesh for each one
+    // by its size on screen, so the vertex count follows the pixels covered
+    float pixels_per_unit = window_height * 0.5f / std::tan(FOV * 0.5f);
+    body_lod.build(simulation, view, projection, pixels_per_unit);
 
-        if (instance.emits_light) {
-            set_light_param(num_lights, "pos",      physics.position);
-            set_light_param(num_lights, "colour",   instance.colour);
-            ++num_lights;
+    body_shader->use();
+    for (int lod = 0; lod < BodyLOD::NUM_MESHES; ++lod) {
+        const auto& instances = body_lod.buckets[lod];
+        if (instances.empty()) {
+            continue;
         }
+
+        const auto& mesh = SPHERE_LODS[lod];
+        body_instance_vbos[lod]->set_data(instances, GL_STREAM_DRAW);
+        body_vaos[lod]->use();
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES, 
+            mesh.index_count, 
+            GL_UNSIGNED_SHORT, 
+            (void*) (mesh.first_index * sizeof(unsigned short)),
+            instances.size(),
+            mesh.base_vertex);
     }
 
-    body_shader->uniform_int("num_lights", num_lights);
-    
-    // Update the bodies vertex buffer
-    bodies_instance_vbo->set_data(simulation.body_instance, GL_DYNAMIC_DRAW);
-    
-    body_vao->use();
-    glDrawArraysInstanced(
-        GL_TRIANGLES, 
-        0, 
-        SPHERE_VERTEX_COUNT, 
-        simulation.num_bodies);
+    const auto& impostors = body_lod.buckets[BodyLOD::IMPOSTORS];
+    if (!impostors.empty()) {
+        impostor_shader->use();
+        body_instance_vbos[BodyLOD::IMPOSTORS]->set_data(impostors, GL_STREAM_DRAW);
+        body_vaos[BodyLOD::IMPOSTORS]->use();
+        glDrawArraysInstanced(
+            GL_TRIANGLES, 
+            0, 
+            IMPOSTOR_VERTEX_COUNT, 
+            impostors.size());
+    }
 }
 
 void SimulationFrontend::apply_bloom()
 {
-    constexpr int NUM_ITERATIONS = 3;
-    bloom_shader->use();
+    if (bloom_chain.empty()) {
+        return;
+    }
+
     screen_vao->use();
 
     auto bloom_pass = 
-    [&](GLFrameBuffer *source, GLFrameBuffer *dest, bool horizontal, int tex) {
-        bloom_shader->uniform_int("horizontal", horizontal);
+    [&](Shader *shader, GLFrameBuffer *source, int tex, GLFrameBuffer *dest) {
         dest->use();
+        glViewport(0, 0, dest->get_width(), dest->get_height());
         source->use_texture(tex, GL_TEXTURE0);
+        auto uv_scale = source->uv_scale();
+        shader->uniform_vec2("uv_scale", glm::value_ptr(uv_scale));
         glDrawArrays(GL_TRIANGLES, 0, SCREEN_VERTEX_COUNT);
     };
 
-    bloom_pass(hdr_fbo, bloom_vertical_fbo, false, 1);
-    bloom_pass(bloom_vertical_fbo, bloom_horizontal_fbo, true, 0);
+    // Shrink the light emitters down the chain, blurring at each step
+    bloom_down_shader->use();
+    bloom_pass(bloom_down_shader, hdr_fbo, 1, bloom_chain[0]);
+
+    for (size_t i = 1; i < bloom_chain.size(); ++i) {
+        bloom_pass(bloom_down_shader, bloom_chain[i - 1], 0, bloom_chain[i]);
+    }
+
+    // Then grow them back up, adding each level onto the next larger 
+    // one so the first level ends up with every width of glow
+    bloom_up_shader->use();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
 
-    for (int i = 0; i < NUM_ITERATIONS; ++i) {
-        bloom_pass(bloom_horizontal_fbo, bloom_vertical_fbo, false, 0);
-        bloom_pass(bloom_vertical_fbo, bloom_horizontal_fbo, true, 0);
+    for (size_t i = bloom_chain.size() - 1; i > 0; --i) {
+        bloom_pass(bloom_up_shader, bloom_chain[i], 0, bloom_chain[i - 1]);
     }
+
+    glDisable(GL_BLEND);
+    glViewport(0, 0, window_width, window_height);
 }
 
 void SimulationFrontend::render_scene()
 {
+    // Send the camera to the GPU once for all the shaders
+    CameraBlock camera {
+        projection,
+        view,
+        glm::vec4(cam_pos, 1.0f),
+        glm::vec2(window_width, window_height),
+        NEAR_CLIP,
+        FAR_CLIP
+    };
+    camera_ubo->set_data(camera);
+
     hdr_fbo->use();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -91,11 +141,27 @@ void SimulationFrontend::render_scene()
     draw_bodies();
     apply_bloom();
 
-    use_default_framebuffer();
+    if (output_fbo != nullptr) {
+        output_fbo->use();
+    } else {
+        use_default_framebuffer();
+    }
     glClear(GL_DEPTH_BUFFER_BIT);
     final_shader->use();
+    screen_vao->use();
+    auto uv_scale = hdr_fbo->uv_scale();
     hdr_fbo->use_texture(0, GL_TEXTURE0);
-    bloom_horizontal_fbo->use_texture(0, GL_TEXTURE1);
+    final_shader->uniform_vec2("uv_scale", glm::value_ptr(uv_scale));
+
+    // Each level adds roughly the emitters' brightness again
+    float bloom_strength = 0.0f;
+    if (!bloom_chain.empty()) {
+        auto bloom_uv_scale = bloom_chain[0]->uv_scale();
+        bloom_chain[0]->use_texture(0, GL_TEXTURE1);
+        bloom_strength = 1.0f / bloom_chain.size();
+        final_shader->uniform_vec2("bloom_uv_scale", glm::value_ptr(bloom_uv_scale));
+    }
+    final_shader->uniform_float("bloom_strength", bloom_strength);
     glDrawArrays(GL_TRIANGLES, 0, SCREEN_VERTEX_COUNT);
 }
 
@@ -7,7 +7,7 @@
 // GLFrameBuffer
 
 GLFrameBuffer::GLFrameBuffer(int w, int h)
-: width(w), height(h)
+: width(w), height(h), storage_width(w), storage_height(h)
 {
     glGenFramebuffers(1, &handle);
     use();
@@ -15,10 +15,14 @@ GLFrameBuffer::GLFrameBuffer(int w, int h)
 
 GLFrameBuffer::~GLFrameBuffer()
 {
+    glDeleteTextures(textures.size(), textures.data());
+    if (renderbuffer != 0) {
+        glDeleteRenderbuffers(1, &renderbuffer);
+    }
     glDeleteFramebuffers(1, &handle);
 }
 
-void GLFrameBuffer::attach_textures(int count)
+void GLFrameBuffer::attach_textures(int count, GLenum format)
 {
     use();
     std::vector<unsigned> attachments;
@@ -28,8 +32,8 @@ void GLFrameBuffer::attach_textures(int count)
         glGenTextures(1, &texture);
         glBindTexture(GL_TEXTURE_2D, texture);
         glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGBA16F, 
-            width, height, 0, 
+            GL_TEXTURE_2D, 0, format, 
+            storage_width, storage_height, 0, 
             GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);  
@@ -42,6 +46,7 @@ void GLFrameBuffer::attach_textures(int count)
             texture, 
             0);
         textures.push_back(texture);
+        formats.push_back(format);
         attachments.push_back(GL_COLOR_ATTACHMENT0 + i);
     }
 
@@ -59,8 +64,8 @@ void GLFrameBuffer::attach_renderbuffer()
     glRenderbufferStorage(
         GL_RENDERBUFFER, 
         GL_DEPTH_COMPONENT, 
-        width, 
-        height);
+        storage_width, 
+        storage_height);
     glFramebufferRenderbuffer(
         GL_FRAMEBUFFER, 
         GL_DEPTH_ATTACHMENT, 
@@ -68,6 +73,60 @@ void GLFrameBuffer::attach_renderbuffer()
         renderbuffer);
 }
 
+glm::vec2 GLFrameBuffer::uv_scale() const
+{
+    return glm::vec2(
+        (float) width / storage_width, 
+        (float) height / storage_height);
+}
+
+void GLFrameBuffer::resize(int w, int h)
+{
+    width  = w;
+    height = h;
+
+    if (w > storage_width || h > storage_height) {
+        auto round_up = [](int size) {
+            return (size + SIZE_BUCKET - 1) / SIZE_BUCKET * SIZE_BUCKET;
+        };
+        allocate_storage(
+            std::max(round_up(w), storage_width), 
+            std::max(round_up(h), storage_height));
+    }
+}
+
+void GLFrameBuffer::trim()
+{
+    if (width != storage_width || height != storage_height) {
+        allocate_storage(width, height);
+    }
+}
+
+void GLFrameBuffer::allocate_storage(int w, int h)
+{
+    // Respecify the existing textures and renderbuffer in place. 
+    // They stay attached, so the framebuffer needs no rebuilding.
+    storage_width  = w;
+    storage_height = h;
+
+    for (size_t i = 0; i < textures.size(); ++i) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(
+            GL_TEXTURE_2D, 0, formats[i], 
+            storage_width, storage_height, 0, 
+            GL_RGBA, GL_FLOAT, NULL);
+    }
+
+    if (renderbuffer != 0) {
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        glRenderbufferStorage(
+            GL_RENDERBUFFER, 
+            GL_DEPTH_COMPONENT, 
+            storage_width, 
+            storage_height);
+    }
+}
+
 void GLFrameBuffer::use_texture(int index, unsigned texture_index) const
 {
     glActiveTexture(texture_index);
@@ -106,11 +165,83 @@ GLVertexBuffer::~GLVertexBuffer()
     glDeleteBuffers(1, &handle);
 }
 
+void GLVertexBuffer::allocate(size_t size, GLenum usage)
+{
+    use();
+    glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(size, 1), NULL, usage);
+}
+
 void GLVertexBuffer::use() const
 {
     glBindBuffer(GL_ARRAY_BUFFER, handle);
 }
 
+// GLIndexBuffer
+
+GLIndexBuffer::GLIndexBuffer() 
+{
+    glGenBuffers(1, &handle);
+}
+
+GLIndexBuffer::~GLIndexBuffer()
+{
+    glDeleteBuffers(1, &handle);
+}
+
+void GLIndexBuffer::use() const
+{
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle);
+}
+
+// GLTextureBuffer
+
+GLTextureBuffer::GLTextureBuffer(GLenum fmt)
+: format(fmt)
+{
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+
+    // The texture refers to the buffer object, so it 
+    // sees new data without being attached again
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+}
+
+GLTextureBuffer::~GLTextureBuffer()
+{
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+}
+
+void GLTextureBuffer::allocate(size_t size, GLenum usage)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(size, 1), NULL, usage);
+}
+
+void GLTextureBuffer::use(unsigned texture_index) const
+{
+    glActiveTexture(texture_index);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// GLUniformBuffer
+
+GLUniformBuffer::GLUniformBuffer(size_t size, unsigned binding)
+{
+    glGenBuffers(1, &handle);
+    glBindBuffer(GL_UNIFORM_BUFFER, handle);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, handle);
+}
+
+GLUniformBuffer::~GLUniformBuffer()
+{
+    glDeleteBuffers(1, &handle);
+}
+
 // GLVertexArray
 
 GLVertexArray::GLVertexArray() 
@@ -128,3 +259,8 @@ void GLVertexArray::use() const
     glBindVertexArray(handle);
 }
 
+void GLVertexArray::set_indices(GLIndexBuffer& buffer)
+{
+    use();
+    buffer.use();
+}
@@ -2,25 +2,49 @@
 #define __GLOBJECTS
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <iostream>
 
+// The framebuffer's storage can be larger than the area in use, so that
+// resizing doesn't have to reallocate every time. Draw into the used 
+// area with a matching viewport, and scale texture coordinates by 
+// uv_scale() when sampling the textures.
 class GLFrameBuffer {
+    // Storage grows in steps of this many pixels
+    static constexpr int SIZE_BUCKET = 256;
+
     unsigned handle;
-    unsigned renderbuffer;
+    unsigned renderbuffer = 0;
     int width;
     int height;
+    int storage_width;
+    int storage_height;
     std::vector<unsigned> textures;
+    std::vector<GLenum> formats;
 
 public:
     GLFrameBuffer(int w, int h);
     ~GLFrameBuffer();
-    void attach_textures(int count);
+    void attach_textures(int count, GLenum format = GL_RGBA16F);
     void attach_renderbuffer();
     void use_texture(int index, unsigned texture_index) const;
     void use() const;
     void check() const;
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    glm::vec2 uv_scale() const;
+
+    // Change the used area, only reallocating if it no longer fits. 
+    // Storage is then rounded up to a whole number of buckets.
+    void resize(int w, int h);
+    // Shrink the storage to fit the used area, once resizing has settled
+    void trim();
+
+private:
+    void allocate_storage(int w, int h);
 };
 
 void use_default_framebuffer();
@@ -35,9 +59,21 @@ public:
     void set_data(const typename std::vector<T>& buffer, GLenum usage);
     template<typename T, size_t N> 
     void set_data(const typename std::array<T, N>& buffer, GLenum usage);
+    // Storage without data, to be filled in parts with set_sub_data
+    void allocate(size_t size, GLenum usage);
+    // Overwrites count elements, starting offset bytes in
+    template<typename T>
+    void set_sub_data(size_t offset, const T *data, size_t count);
     void use() const;
 };
 
+template<typename T>
+void GLVertexBuffer::set_sub_data(size_t offset, const T *data, size_t count)
+{
+    use();
+    glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(T) * count, data);
+}
+
 template<typename T> 
 void GLVertexBuffer::set_data(const typename std::vector<T>& buffer, GLenum usage)
 {
@@ -54,6 +90,74 @@ void GLVertexBuffer::set_data(const typename std::array<T, N>& buffer, GLenum us
     glBufferData(GL_ARRAY_BUFFER, size, buffer.data(), usage);
 }
 
+class GLIndexBuffer {
+    unsigned handle;
+
+public:
+    GLIndexBuffer();
+    ~GLIndexBuffer();
+    template<typename T, size_t N> 
+    void set_data(const typename std::array<T, N>& buffer, GLenum usage);
+    void use() const;
+};
+
+template<typename T, size_t N> 
+void GLIndexBuffer::set_data(const typename std::array<T, N>& buffer, GLenum usage)
+{
+    use();
+    size_t size = sizeof(T) * buffer.size();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, buffer.data(), usage);
+}
+
+// A buffer exposed to shaders as a texture, read with texelFetch from
+// a samplerBuffer. Used for per-frame arrays too big for uniforms.
+class GLTextureBuffer {
+    unsigned buffer;
+    unsigned texture;
+    GLenum format;
+
+public:
+    GLTextureBuffer(GLenum fmt);
+    ~GLTextureBuffer();
+    template<typename T> 
+    void set_data(const typename std::vector<T>& data, GLenum usage);
+    // Storage without data, for filling on the GPU
+    void allocate(size_t size, GLenum usage);
+    void use(unsigned texture_index) const;
+    unsigned buffer_handle() const { return buffer; }
+};
+
+template<typename T> 
+void GLTextureBuffer::set_data(const typename std::vector<T>& data, GLenum usage)
+{
+    // A buffer texture needs storage, so never upload nothing
+    static const T empty {};
+    size_t size = sizeof(T) * std::max<size_t>(data.size(), 1);
+    const void *ptr = data.empty() ? &empty : data.data();
+
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, ptr, usage);
+}
+
+// A uniform block's storage, attached to a fixed binding point so any
+// shader whose block is bound to the same point reads the same data
+class GLUniformBuffer {
+    unsigned handle;
+
+public:
+    GLUniformBuffer(size_t size, unsigned binding);
+    ~GLUniformBuffer();
+    template<typename T>
+    void set_data(const T& data);
+};
+
+template<typename T>
+void GLUniformBuffer::set_data(const T& data)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, handle);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+}
+
 class GLVertexArray {
     unsigned handle;
     size_t count = 0;
@@ -68,6 +172,8 @@ public:
     GLVertexArray();
     ~GLVertexArray();
     void use() const;
+    // The index buffer binding is part of the vertex array's state
+    void set_indices(GLIndexBuffer& buffer);
 
     template<typename ...T>
     void add_attrs(GLVertexBuffer& buffer, T... data_args);
@@ -0,0 +1,157 @@
+#include "gpu_trajectories.h"
+
+#include <glm/gtc/type_ptr.hpp>
+#include <chrono>
+
+GPUTrajectories::GPUTrajectories(unsigned camera_binding)
+{
+    for (int i = 0; i < 2; ++i) {
+        positions[i]  = new GLTextureBuffer(GL_RGBA32F);
+        velocities[i] = new GLTextureBuffer(GL_RGBA32F);
+    }
+    trajectory = new GLTextureBuffer(GL_RGBA32F);
+    empty_vao  = new GLVertexArray();
+
+    step_shader = new Shader("resources/trajectory_step_vert.glsl",
+                             { "tf_position", "tf_velocity" });
+    draw_shader = new Shader({ "resources/camera.glsl",
+                               "resources/trajectory_vert.glsl" },
+                             { "resources/line_frag.glsl" });
+
+    step_shader->use();
+    step_shader->uniform_int("positions",  0);
+    step_shader->uniform_int("velocities", 1);
+    step_shader->uniform_float("grav_constant", GRAV_CONSTANT);
+
+    draw_shader->bind_block("Camera", camera_binding);
+    draw_shader->use();
+    draw_shader->uniform_int("trajectory", 0);
+}
+
+GPUTrajectories::~GPUTrajectories()
+{
+    for (int i = 0; i < 2; ++i) {
+        delete positions[i];
+        delete velocities[i];
+    }
+    delete trajectory;
+    delete empty_vao;
+    delete step_shader;
+    delete draw_shader;
+}
+
+void GPUTrajectories::restart(const Simulation& simulation)
+{
+    int count = simulation.num_bodies;
+    computed_bodies = count;
+    settings = simulation.trajectory_settings;
+    step   = 0;
+    source = 0;
+    valid  = true;
+    if (count == 0) {
+        return;
+    }
+
+    // Upload the starting state, with the mass in 
+    // the w component as the step shader needs it
+    upload_positions.resize(count);
+    upload_velocities.resize(count);
+    for (int i = 0; i < count; ++i) {
+        const auto& physics  = simulation.get_physics(i);
+        upload_positions[i]  = glm::vec4(physics.position, physics.mass);
+        upload_velocities[i] = glm::vec4(physics.velocity, 0.0f);
+    }
+
+    size_t state_size = sizeof(glm::vec4) * count;
+    int samples = (settings.horizon + settings.period - 1) / settings.period;
+    positions[0]->set_data(upload_positions, GL_DYNAMIC_COPY);
+    velocities[0]->set_data(upload_velocities, GL_DYNAMIC_COPY);
+    positions[1]->allocate(state_size, GL_DYNAMIC_COPY);
+    velocities[1]->allocate(state_size, GL_DYNAMIC_COPY);
+    trajectory->allocate(state_size * samples, GL_DYNAMIC_COPY);
+}
+
+void GPUTrajectories::compute(const Simulation& simulation)
+{
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t checksum = simulation.trajectory_checksum();
+    if (!valid || checksum != source_checksum) {
+        source_checksum = checksum;
+        restart(simulation);
+    }
+
+    int count = computed_bodies;
+    if (count == 0 || step >= settings.horizon) {
+        return;
+    }
+
+    size_t state_size = sizeof(glm::vec4) * count;
+    step_shader->use();
+    step_shader->uniform_int("num_bodies", count);
+    step_shader->uniform_float("time_step", simulation.integrator_settings.time_step);
+    empty_vao->use();
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    // Timed by how long the steps take to submit. The driver stalls 
+    // once too many are queued, so this follows the GPU's pace.
+    int immediate = std::min(Simulation::TRAJECTORY_INITIAL_STEPS, settings.horizon);
+    float budget_ms = simulation.trajectory_budget_ms;
+    auto budget = std::chrono::duration<float, std::milli>(budget_ms);
+    auto start  = Clock::now();
+
+    while (step < settings.horizon) {
+        int dest = 1 - source;
+
+        positions[source]->use(GL_TEXTURE0);
+        velocities[source]->use(GL_TEXTURE1);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, positions[dest]->buffer_handle());
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, velocities[dest]->buffer_handle());
+
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+
+        if (step % settings.period == 0) {
+            int sample = step / settings.period;
+            glBindBuffer(GL_COPY_READ_BUFFER,  positions[dest]->buffer_handle());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, trajectory->buffer_handle());
+            glCopyBufferSubData(
+                GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 
+                0, state_size * sample, state_size);
+        }
+
+        source = dest;
+        ++step;
+
+        bool over_budget = budget_ms > 0.0f && Clock::now() - start > budget;
+        if (step >= immediate && over_budget) {
+            break;
+        }
+    }
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void GPUTrajectories::draw(const Simulation& simulation) const
+{
+    // Only the points computed so far
+    int samples = (step + settings.period - 1) / settings.period;
+    if (computed_bodies == 0 || samples == 0) {
+        return;
+    }
+
+    int relative = simulation.index_of(simulation.draw_tracers_relative_to);
+    auto relative_origin = simulation.get_physics(relative).orig_position;
+
+    draw_shader->use();
+    draw_shader->uniform_int("num_bodies", computed_bodies);
+    draw_shader->uniform_int("relative_body", relative);
+    draw_shader->uniform_vec3("relative_origin", glm::value_ptr(relative_origin));
+
+    trajectory->use(GL_TEXTURE0);
+    empty_vao->use();
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, samples, computed_bodies);
+}
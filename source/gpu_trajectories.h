@@ -0,0 +1,49 @@
+#pragma once
+
+#include "simulation.h"
+#include "gl_objects.h"
+#include "shader.h"
+
+#include <array>
+
+// Computes the trajectory previews on the GPU instead of in
+// Simulation::calculate_trajectories. Each step is a transform feedback
+// pass over the bodies, ping-ponging their positions and velocities 
+// between two pairs of buffers. Every period steps the new positions 
+// are copied into the trajectory buffer on the GPU, which the line 
+// shader reads directly, so nothing is integrated on or uploaded from
+// the CPU but the starting state. Follows the simulation's trajectory
+// settings and budget, extending the previews across frames the same
+// way the CPU does. Only needs OpenGL 3.3, so it also runs on software
+// implementations such as Mesa's llvmpipe.
+class GPUTrajectories {
+    std::array<GLTextureBuffer*, 2> positions;
+    std::array<GLTextureBuffer*, 2> velocities;
+    GLTextureBuffer *trajectory;
+    GLVertexArray   *empty_vao;     // The shaders take no attributes
+    Shader *step_shader;
+    Shader *draw_shader;
+
+    std::vector<glm::vec4> upload_positions;
+    std::vector<glm::vec4> upload_velocities;
+    int computed_bodies = 0;
+
+    // Progress through the current previews
+    TrajectorySettings settings;
+    uint64_t source_checksum = 0;
+    bool valid = false;
+    int step = 0;
+    int source = 0;     // Which of the buffer pairs holds the latest step
+
+    void restart(const Simulation& simulation);
+
+public:
+    // Lines are drawn with the camera block at camera_binding
+    GPUTrajectories(unsigned camera_binding);
+    ~GPUTrajectories();
+
+    // Starts the previews again if the simulation has changed, 
+    // then extends them within the simulation's budget
+    void compute(const Simulation& simulation);
+    void draw(const Simulation& simulation) const;
+};
@@ -0,0 +1,342 @@
+#include "headless.h"
+#include "alloc_counter.h"
+#include "checkpoint.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+static void print_usage()
+{
+    std::cout 
+        << "Usage: prog --headless [options]\n"
+        << "  --load <file.sim>      Load a saved simulation\n"
+        << "  --import <file>        Import bodies from a CSV or whitespace\n"
+        << "                         separated catalogue, - for stdin\n"
+        << "  --columns <map>        Catalogue columns, counting from 0,\n"
+        << "                         default x=0,y=1,z=2,vx=3,vy=4,vz=5,mass=6\n"
+        << "                         (also radius and name)\n"
+        << "  --length-scale <x>     Multiply catalogue positions and radii\n"
+        << "  --velocity-scale <x>   Multiply catalogue velocities\n"
+        << "  --mass-scale <x>       Multiply catalogue masses\n"
+        << "  --stream               Read the catalogue a block at a time\n"
+        << "  --generate <scene>     Generate a scene: plummer, disc,\n"
+        << "                         collision, cube or solar\n"
+        << "  --count <n>            Number of bodies to generate\n"
+        << "  --seed <n>             Seed for the scene generator\n"
+        << "  --scale <x>            Size of the generated scene\n"
+        << "  --mass <x>             Total mass of the generated scene\n"
+        << "  --steps <n>            Number of steps to run\n"
+        << "  --report <n>           Print progress every n steps\n"
+        << "  --save <file.sim>      Save the simulation once finished\n"
+        << "  --integrator <type>    automatic, euler or wisdom-holman\n"
+        << "  --time-step <x>        Time advanced by each step\n"
+        << "  --preview              Repeatedly compute trajectory previews\n"
+        << "                         instead of running the simulation\n"
+        << "  --check-allocations    Fail if steps allocate after warming\n"
+        << "                         up, recording trails as the window\n"
+        << "                         does (needs the benchmark build)\n"
+        << "  --distributed          Split the bodies across MPI ranks\n"
+        << "                         (needs the distributed build)\n"
+        << "  --theta <x>            Distributed: approximate other ranks'\n"
+        << "                         bodies by their centre of mass when\n"
+        << "                         size/distance is below x. 0 is exact\n"
+        << "  --rebalance <n>        Distributed: redistribute the bodies\n"
+        << "                         every n steps\n"
+        << "  --checkpoint <file>    Periodically save the run's progress\n"
+        << "  --checkpoint-every <n> Checkpoint every n steps (default\n"
+        << "                         1000, 0 for never)\n"
+        << "  --checkpoint-seconds <t>\n"
+        << "                         Also checkpoint every t seconds\n"
+        << "  --resume <file>        Continue the run saved in a checkpoint,\n"
+        << "                         up to --steps in total, with the scene\n"
+        << "                         and settings it was saved with\n";
+}
+
+static bool parse_integrator_type(const char *name, IntegratorType& type)
+{
+    for (int i = 0; i < int(std::size(INTEGRATOR_NAMES)); ++i) {
+        if (std::strcmp(name, INTEGRATOR_NAMES[i]) == 0) {
+            type = IntegratorType(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_scene_argument(const char *arg, const char *value,
+                          SceneParameters& scene, bool& generate)
+{
+    if (std::strcmp(arg, "--generate") == 0) {
+        if (!parse_scene_type(value, scene.type)) {
+            std::cerr << "Unknown scene type: " << value << "\n";
+            return false;
+        }
+        generate = true;
+    } else if (std::strcmp(arg, "--count") == 0) {
+        scene.count = std::atoi(value);
+    } else if (std::strcmp(arg, "--seed") == 0) {
+        scene.seed = std::strtoull(value, nullptr, 10);
+    } else if (std::strcmp(arg, "--scale") == 0) {
+        scene.scale = std::atof(value);
+    } else if (std::strcmp(arg, "--mass") == 0) {
+        scene.mass = std::atof(value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_headless_options(int argc, char **argv, HeadlessOptions& options)
+{
+    SceneParameters scene;
+    bool generate = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        
+        // Flags without a value
+        if (std::strcmp(arg, "--headless") == 0) {
+            continue;
+        } else if (std::strcmp(arg, "--preview") == 0) {
+            options.preview = true;
+            continue;
+        } else if (std::strcmp(arg, "--check-allocations") == 0) {
+            options.check_allocations = true;
+            continue;
+        } else if (std::strcmp(arg, "--distributed") == 0) {
+            options.distributed = true;
+            continue;
+        } else if (std::strcmp(arg, "--stream") == 0) {
+            options.catalogue.streaming = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage();
+            return false;
+        }
+        const char *value = argv[++i];
+
+        if (parse_scene_argument(arg, value, scene, generate)) {
+            continue;
+        } else if (std::strcmp(arg, "--load") == 0) {
+            options.load_path = value;
+        } else if (std::strcmp(arg, "--import") == 0) {
+            options.catalogue.path = value;
+        } else if (std::strcmp(arg, "--columns") == 0) {
+            if (!parse_catalogue_columns(value, options.catalogue)) {
+                std::cerr << "Invalid column mapping: " << value << "\n";
+                return false;
+            }
+        } else if (std::strcmp(arg, "--length-scale") == 0) {
+            options.catalogue.length_scale = std::atof(value);
+        } else if (std::strcmp(arg, "--velocity-scale") == 0) {
+            options.catalogue.velocity_scale = std::atof(value);
+        } else if (std::strcmp(arg, "--mass-scale") == 0) {
+            options.catalogue.mass_scale = std::atof(value);
+        } else if (std::strcmp(arg, "--save") == 0) {
+            options.save_path = value;
+        } else if (std::strcmp(arg, "--steps") == 0) {
+            options.steps = std::atoi(value);
+        } else if (std::strcmp(arg, "--report") == 0) {
+            options.report_every = std::atoi(value);
+        } else if (std::strcmp(arg, "--theta") == 0) {
+            options.theta = std::atof(value);
+        } else if (std::strcmp(arg, "--rebalance") == 0) {
+            options.rebalance_every = std::atoi(value);
+        } else if (std::strcmp(arg, "--integrator") == 0) {
+            IntegratorType type;
+            if (!parse_integrator_type(value, type)) {
+                std::cerr << "Unknown integrator: " << value << "\n";
+                return false;
+            }
+            options.integrator = type;
+        } else if (std::strcmp(arg, "--time-step") == 0) {
+            options.time_step = std::atof(value);
+            if (!(*options.time_step > 0.0f)) {
+                std::cerr << "The time step must be positive\n";
+                return false;
+            }
+        } else if (std::strcmp(arg, "--checkpoint") == 0) {
+            options.checkpoint_path = value;
+        } else if (std::strcmp(arg, "--checkpoint-every") == 0) {
+            options.checkpoint_every = std::atoi(value);
+        } else if (std::strcmp(arg, "--checkpoint-seconds") == 0) {
+            options.checkpoint_seconds = std::atof(value);
+        } else if (std::strcmp(arg, "--resume") == 0) {
+            options.resume_path = value;
+        } else {
+            print_usage();
+            return false;
+        }
+    }
+
+    // A checkpoint holds the scene and its settings, so resuming with 
+    // different ones wouldn't continue the same run
+    bool changes_scene = !options.load_path.empty() || !options.catalogue.path.empty()
+        || generate || options.integrator || options.time_step;
+    if (!options.resume_path.empty() && changes_scene) {
+        std::cerr << "--resume continues the checkpointed scene with its own settings,\n"
+                  << "so it can't be combined with --load, --import, --generate,\n"
+                  << "--integrator or --time-step\n";
+        return false;
+    }
+
+    if (generate) {
+        options.scene = scene;
+    }
+    return true;
+}
+
+void prepare_simulation(Simulation& simulation, const HeadlessOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Nothing draws the trails, so don't accumulate them
+    simulation.record_tracers = false;
+
+    if (!options.load_path.empty()) {
+        simulation.load_simulation(options.load_path);
+    }
+
+    if (!options.catalogue.path.empty()) {
+        auto start  = Clock::now();
+        auto result = import_catalogue(simulation, options.catalogue);
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+        if (!result.ok) {
+            std::cerr << "Failed to read " << options.catalogue.path << "\n";
+        }
+        std::cout << "Imported " << result.imported << " bodies in "
+                  << elapsed.count() << "s";
+        if (result.skipped > 0) {
+            std::cout << ", skipping " << result.skipped << " other lines";
+        }
+        std::cout << "\n";
+    }
+
+    if (options.scene) {
+        auto start = Clock::now();
+        int before = simulation.num_bodies;
+        generate_scene(simulation, *options.scene);
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+        std::cout << "Generated " << simulation.num_bodies - before << " bodies in "
+                  << elapsed.count() << "s\n";
+    }
+
+    if (options.integrator) {
+        simulation.integrator_settings.type = *options.integrator;
+    }
+    if (options.time_step) {
+        simulation.integrator_settings.time_step = *options.time_step;
+    }
+}
+
+int run_headless(const HeadlessOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+    // Steps allowed to allocate while buffers grow to their final size
+    constexpr int WARMUP_STEPS = 2;
+
+    auto seconds_since = [](Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    Simulation simulation;
+    int64_t completed = 0;
+    if (options.resume_path.empty()) {
+        prepare_simulation(simulation, options);
+    } else {
+        simulation.record_tracers = false;
+        completed = load_checkpoint(options.resume_path, simulation);
+        if (completed < 0) {
+            std::cerr << "Can't resume from " << options.resume_path << "\n";
+            return 1;
+        }
+        std::cout << "Resuming after step " << completed << "\n";
+    }
+
+    std::cout << "Running " << simulation.num_bodies << " bodies for "
+              << options.steps - completed << " steps\n";
+
+    if (options.check_allocations && !counting_allocations()) {
+        std::cerr << "Allocation counting is not enabled in this build\n";
+        return 1;
+    }
+    // Nothing draws the trails, but the check records them, so it
+    // covers the same work as a run in the window
+    simulation.record_tracers = options.check_allocations;
+
+    if (options.resume_path.empty()) {
+        simulation.state = options.preview
+            ? SimulationState::Waiting
+            : SimulationState::Running;
+    }
+    // Each preview is computed in full, rather than over several steps
+    simulation.trajectory_budget_ms = 0.0f;
+    auto start = Clock::now();
+    size_t warm_allocations = 0;
+
+    std::unique_ptr<Checkpointer> checkpointer;
+    if (!options.checkpoint_path.empty()) {
+        checkpointer = std::make_unique<Checkpointer>(options.checkpoint_path);
+        // Before the steps, so checkpoints don't count as allocations
+        checkpointer->reserve(simulation);
+    }
+    auto last_checkpoint = start;
+
+    for (int64_t step = completed + 1; step <= options.steps; ++step) {
+        if (options.preview) {
+            // Otherwise the finished previews would be kept
+            simulation.clear_tracers();
+        }
+        simulation.update();
+
+        if (checkpointer) {
+            bool due = options.checkpoint_every > 0 
+                && step % options.checkpoint_every == 0;
+            bool overdue = options.checkpoint_seconds > 0.0 
+                && seconds_since(last_checkpoint) >= options.checkpoint_seconds;
+            if (due || overdue) {
+                checkpointer->save(simulation, step);
+                last_checkpoint = Clock::now();
+            }
+        }
+
+        if (step == completed + WARMUP_STEPS) {
+            warm_allocations = allocation_count();
+        }
+
+        if (options.report_every > 0 && step % options.report_every == 0) {
+            double elapsed = seconds_since(start);
+            std::cout << "step " << step << ": " << elapsed << "s, "
+                      << (step - completed) / elapsed << " steps/s\n";
+        }
+    }
+
+    std::cout << "Finished in " << seconds_since(start) << "s\n";
+
+    if (checkpointer) {
+        checkpointer->flush();
+        if (!checkpointer->ok()) {
+            return 1;
+        }
+    }
+
+    if (counting_allocations() && options.steps - completed > WARMUP_STEPS) {
+        size_t steady = allocation_count() - warm_allocations;
+        std::cout << "Allocations after warm-up: " << steady << "\n";
+
+        if (options.check_allocations && steady > 0) {
+            std::cerr << "Steady-state steps allocated memory\n";
+            return 1;
+        }
+    }
+
+    if (!options.save_path.empty()) {
+        simulation.save_simulation(options.save_path);
+    }
+    return 0;
+}
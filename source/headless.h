@@ -0,0 +1,43 @@
+#pragma once
+
+#include "simulation.h"
+#include "scene_generators.h"
+#include "catalogue.h"
+
+#include <string>
+#include <optional>
+
+// Options for running a simulation without a window, e.g.
+//   prog --headless --generate plummer --count 100000 --steps 500
+struct HeadlessOptions {
+    std::string load_path;
+    std::string save_path;
+    std::optional<SceneParameters> scene;
+    CatalogueOptions catalogue;      // Imported if the path is set
+    int steps = 1000;
+    int report_every = 100;
+    bool preview = false;            // Step trajectory previews instead
+    bool check_allocations = false;  // Fail if steady-state steps allocate
+    bool distributed = false;        // Split the bodies across MPI ranks
+    float theta = 0.0f;              // Opening angle for other ranks' bodies
+    int rebalance_every = 50;
+    std::string checkpoint_path;     // Checkpoint here if not empty
+    int checkpoint_every = 1000;     // Steps between checkpoints, 0 for none
+    double checkpoint_seconds = 0.0; // Time between checkpoints, 0 for none
+    std::string resume_path;         // Continue the run in this checkpoint
+    // Override the scene's integrator settings if set
+    std::optional<IntegratorType> integrator;
+    std::optional<float> time_step;
+};
+
+// Handles the scene generation options shared by the command line modes:
+// --generate, --count, --seed, --scale and --mass. Returns false if arg 
+// isn't one of them, or the scene type is unknown.
+bool parse_scene_argument(const char *arg, const char *value,
+                          SceneParameters& scene, bool& generate);
+
+// Loads and generates the scene the options ask for
+void prepare_simulation(Simulation& simulation, const HeadlessOptions& options);
+
+bool parse_headless_options(int argc, char **argv, HeadlessOptions& options);
+int run_headless(const HeadlessOptions& options);
@@ -0,0 +1,127 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+void LightClusters::build(const Simulation& simulation,
+                          const glm::mat4& view, const glm::mat4& projection,
+                          float near_clip, float far_clip, float light_range)
+{
+    lights.clear();
+    light_bounds.clear();
+    light_depth.clear();
+
+    // Depth slices are spaced logarithmically, matching body_frag.glsl
+    float log_ratio = std::log(far_clip / near_clip);
+    auto slice_of = [&](float depth) {
+        int slice = std::log(depth / near_clip) / log_ratio * SLICES;
+        return std::clamp(slice, 0, SLICES - 1);
+    };
+    auto tile_of = [](float ndc, int tiles) {
+        int tile = (ndc * 0.5f + 0.5f) * tiles;
+        return std::clamp(tile, 0, tiles - 1);
+    };
+
+    for (int i = 0; i < simulation.num_bodies; ++i) {
+        const auto& instance = simulation.get_instance(i);
+        if (!instance.emits_light) {
+            continue;
+        }
+
+        auto position = simulation.get_physics(i).position;
+        auto centre   = glm::vec3(view * glm::vec4(position, 1.0f));
+        float depth   = -centre.z;
+        float range   = light_range;
+
+        if (depth + range < near_clip || depth - range > far_clip) {
+            continue;
+        }
+
+        Bounds bounds;
+        bounds.min_z = slice_of(std::max(depth - range, near_clip));
+        bounds.max_z = slice_of(std::min(depth + range, far_clip));
+
+        if (depth - range <= near_clip) {
+            // The light's range crosses the near plane, so
+            // it could reach anywhere on screen
+            bounds.min_x = 0;
+            bounds.max_x = TILES_X - 1;
+            bounds.min_y = 0;
+            bounds.max_y = TILES_Y - 1;
+        } else {
+            // Project the corners of the box around the light's range
+            glm::vec2 min(INFINITY), max(-INFINITY);
+            for (int corner = 0; corner < 8; ++corner) {
+                glm::vec4 point(
+                    centre.x + ((corner & 1) ? range : -range),
+                    centre.y + ((corner & 2) ? range : -range),
+                    centre.z + ((corner & 4) ? range : -range),
+                    1.0f);
+                auto clip = projection * point;
+                auto ndc  = glm::vec2(clip.x, clip.y) / clip.w;
+                min = glm::min(min, ndc);
+                max = glm::max(max, ndc);
+            }
+
+            if (max.x < -1.0f || min.x > 1.0f || max.y < -1.0f || min.y > 1.0f) {
+                continue;
+            }
+
+            bounds.min_x = tile_of(min.x, TILES_X);
+            bounds.max_x = tile_of(max.x, TILES_X);
+            bounds.min_y = tile_of(min.y, TILES_Y);
+            bounds.max_y = tile_of(max.y, TILES_Y);
+        }
+
+        lights.push_back(glm::vec4(position, range));
+        lights.push_back(glm::vec4(instance.colour, 0.0f));
+        light_bounds.push_back(bounds);
+        light_depth.push_back(depth);
+    }
+
+    // Bin the nearest lights first, so any that don't
+    // fit in a full cluster are the furthest away
+    order.resize(light_bounds.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return light_depth[a] < light_depth[b];
+    });
+
+    auto for_each_cluster = [&](const Bounds& bounds, auto&& fn) {
+        for (int z = bounds.min_z; z <= bounds.max_z; ++z) {
+            for (int y = bounds.min_y; y <= bounds.max_y; ++y) {
+                for (int x = bounds.min_x; x <= bounds.max_x; ++x) {
+                    fn((z * TILES_Y + y) * TILES_X + x);
+                }
+            }
+        }
+    };
+
+    // Count the lights in each cluster, then lay the clusters' index
+    // lists out back to back and fill them in a second pass
+    grid.assign(NUM_CLUSTERS, glm::uvec2(0));
+    for (auto light : order) {
+        for_each_cluster(light_bounds[light], [&](int cluster) {
+            auto& count = grid[cluster].y;
+            count = std::min<uint32_t>(count + 1, MAX_LIGHTS_PER_CLUSTER);
+        });
+    }
+
+    uint32_t offset = 0;
+    for (auto& cell : grid) {
+        cell.x  = offset;
+        offset += cell.y;
+        cell.y  = 0;
+    }
+
+    indices.resize(offset);
+    for (auto light : order) {
+        for_each_cluster(light_bounds[light], [&](int cluster) {
+            auto& cell = grid[cluster];
+            if (cell.y < MAX_LIGHTS_PER_CLUSTER) {
+                indices[cell.x + cell.y++] = light;
+            }
+        });
+    }
+}
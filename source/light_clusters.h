@@ -0,0 +1,43 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+// Bins the light emitting bodies into a grid of view space clusters
+// (screen tiles split into depth slices), so that each fragment only
+// has to shade the lights whose range overlaps its cluster. The three
+// arrays are uploaded as texture buffers once per frame.
+class LightClusters {
+public:
+    static constexpr int TILES_X = 16;
+    static constexpr int TILES_Y = 9;
+    static constexpr int SLICES  = 24;
+    static constexpr int NUM_CLUSTERS = TILES_X * TILES_Y * SLICES;
+    // Any further lights are dropped from a cluster, furthest first
+    static constexpr int MAX_LIGHTS_PER_CLUSTER = 128;
+
+    // Two texels per light: position and range, then colour
+    std::vector<glm::vec4> lights;
+    // Offset into indices and light count for each cluster
+    std::vector<glm::uvec2> grid;
+    std::vector<uint32_t> indices;
+
+    void build(const Simulation& simulation,
+               const glm::mat4& view, const glm::mat4& projection,
+               float near_clip, float far_clip, float light_range);
+
+private:
+    struct Bounds {
+        int min_x, max_x;
+        int min_y, max_y;
+        int min_z, max_z;
+    };
+
+    std::vector<Bounds> light_bounds;
+    std::vector<float> light_depth;
+    std::vector<uint32_t> order;
+};
@@ -1,7 +1,39 @@
 #include "frontend.h"
+#include "headless.h"
+#include "distributed.h"
+#include "ensemble.h"
 
-int main()
+#include <cstring>
+
+int main(int argc, char **argv)
 {
+    if (argc > 1 && std::strcmp(argv[1], "--headless") == 0) {
+        HeadlessOptions options;
+        if (!parse_headless_options(argc, argv, options)) {
+            return 1;
+        }
+        return options.distributed
+            ? run_distributed(options)
+            : run_headless(options);
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--export") == 0) {
+        ExportOptions options;
+        if (!parse_export_options(argc, argv, options)) {
+            return 1;
+        }
+        SimulationFrontend sim(true);
+        return sim.run_export(options);
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--ensemble") == 0) {
+        EnsembleOptions options;
+        if (!parse_ensemble_options(argc, argv, options)) {
+            return 1;
+        }
+        return run_ensemble(options);
+    }
+
     SimulationFrontend sim;
     sim.run();
 }
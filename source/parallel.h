@@ -0,0 +1,35 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// Split [0, count) into contiguous chunks and run fn(begin, end) on
+// each chunk from its own thread. Runs inline for small ranges.
+template<typename F>
+void parallel_for(int count, F&& fn, int min_chunk = 1024)
+{
+    int hardware    = std::max(1u, std::thread::hardware_concurrency());
+    int num_threads = std::clamp(count / min_chunk, 1, hardware);
+
+    if (num_threads == 1) {
+        fn(0, count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    int chunk = (count + num_threads - 1) / num_threads;
+
+    for (int t = 1; t < num_threads; ++t) {
+        int begin = std::min(t * chunk, count);
+        int end   = std::min(begin + chunk, count);
+        threads.emplace_back([&fn, begin, end] { fn(begin, end); });
+    }
+
+    fn(0, std::min(chunk, count));
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,235 @@
+#include "picking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+static float surface_area(glm::vec3 min, glm::vec3 max)
+{
+    auto extent = max - min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void BodyBVH::update(const Simulation& simulation)
+{
+    // Refitting keeps the tree valid but it loosens as bodies move
+    // apart, so rebuild once the boxes have grown too much
+    constexpr float MAX_AREA_GROWTH = 2.0f;
+
+    if (simulation.body_version != built_version) {
+        build(simulation);
+        return;
+    }
+
+    if (refit(simulation) > built_area * MAX_AREA_GROWTH) {
+        build(simulation);
+    }
+}
+
+void BodyBVH::build(const Simulation& simulation)
+{
+    nodes.clear();
+    order.resize(simulation.num_bodies);
+    std::iota(order.begin(), order.end(), 0);
+    built_version = simulation.body_version;
+
+    if (simulation.num_bodies == 0) {
+        built_area = 0.0f;
+        return;
+    }
+
+    build_range(simulation, 0, simulation.num_bodies);
+    built_area = refit(simulation);
+}
+
+int BodyBVH::build_range(const Simulation& simulation, int begin, int end)
+{
+    int index = nodes.size();
+    nodes.push_back(Node{});
+
+    int count = end - begin;
+    if (count <= LEAF_SIZE) {
+        nodes[index].first = begin;
+        nodes[index].count = count;
+        return index;
+    }
+
+    auto centre = [&](int i) { return simulation.get_physics(i).position; };
+
+    // Split at the median along the axis the centres spread most on
+    glm::vec3 min(INFINITY), max(-INFINITY);
+    for (int i = begin; i < end; ++i) {
+        min = glm::min(min, centre(order[i]));
+        max = glm::max(max, centre(order[i]));
+    }
+    auto extent = max - min;
+    int axis = (extent.x > extent.y && extent.x > extent.z) ? 0
+             : (extent.y > extent.z) ? 1 : 2;
+
+    int mid = begin + count / 2;
+    std::nth_element(
+        order.begin() + begin,
+        order.begin() + mid,
+        order.begin() + end,
+        [&](int a, int b) { return centre(a)[axis] < centre(b)[axis]; });
+
+    // The left child is built first so it lands directly after this node
+    build_range(simulation, begin, mid);
+    int right = build_range(simulation, mid, end);
+
+    nodes[index].first = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+float BodyBVH::refit(const Simulation& simulation)
+{
+    // Children always come after their parent, so a reverse pass
+    // updates every node after both of its children
+    float total_area = 0.0f;
+
+    for (int n = nodes.size() - 1; n >= 0; --n) {
+        auto& node = nodes[n];
+        glm::vec3 min(INFINITY), max(-INFINITY);
+
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                const auto& physics = simulation.get_physics(order[i]);
+                auto radius = glm::vec3(physics.radius);
+                min = glm::min(min, physics.position - radius);
+                max = glm::max(max, physics.position + radius);
+            }
+        } else {
+            const auto& left  = nodes[n + 1];
+            const auto& right = nodes[node.first];
+            min = glm::min(left.min, right.min);
+            max = glm::max(left.max, right.max);
+            total_area += surface_area(min, max);
+        }
+
+        node.min = min;
+        node.max = max;
+    }
+
+    return total_area;
+}
+
+int BodyBVH::pick(const Simulation& simulation,
+                  glm::vec3 origin, glm::vec3 direction) const
+{
+    if (nodes.empty()) {
+        return Simulation::NO_INDEX;
+    }
+
+    auto inv_dir = glm::vec3(1.0f) / direction;
+
+    // Distance along the ray at which it enters the box, or infinity
+    auto enter_box = [&](const Node& node) {
+        auto t0 = (node.min - origin) * inv_dir;
+        auto t1 = (node.max - origin) * inv_dir;
+        auto near = glm::min(t0, t1);
+        auto far  = glm::max(t0, t1);
+        float enter = std::max({ near.x, near.y, near.z, 0.0f });
+        float exit  = std::min({ far.x, far.y, far.z });
+        return (enter <= exit) ? enter : INFINITY;
+    };
+
+    int best = Simulation::NO_INDEX;
+    float best_t = INFINITY;
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const auto& node = nodes[stack[--top]];
+        if (enter_box(node) >= best_t) {
+            continue;
+        }
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = &node - nodes.data() + 1;
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const auto& physics = simulation.get_physics(order[i]);
+
+            // Ray-sphere intersection, taking the nearest hit in front
+            // of the origin rather than the closest sphere centre
+            auto a = origin - physics.position;
+            float b = glm::dot(a, direction);
+            float c = glm::dot(a, a) - physics.radius * physics.radius;
+            float discriminant = b * b - c;
+            if (discriminant < 0.0f) {
+                continue;
+            }
+
+            float root = std::sqrt(discriminant);
+            float t = (-b - root >= 0.0f) ? -b - root : -b + root;
+            if (t >= 0.0f && t < best_t) {
+                best_t = t;
+                best = order[i];
+            }
+        }
+    }
+
+    return best;
+}
+
+void BodyBVH::select(const Simulation& simulation,
+                     const std::array<glm::vec4, 5>& planes,
+                     std::vector<int>& out) const
+{
+    out.clear();
+    if (nodes.empty()) {
+        return;
+    }
+
+    auto inside = [&](glm::vec3 point) {
+        for (const auto& plane : planes) {
+            if (glm::dot(plane.xyz(), point) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Whether any part of the box is on the inner side of every plane,
+    // testing the corner furthest along each plane's normal
+    auto overlaps = [&](const Node& node) {
+        for (const auto& plane : planes) {
+            glm::vec3 corner(
+                plane.x > 0.0f ? node.max.x : node.min.x,
+                plane.y > 0.0f ? node.max.y : node.min.y,
+                plane.z > 0.0f ? node.max.z : node.min.z);
+            if (glm::dot(plane.xyz(), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const auto& node = nodes[stack[--top]];
+        if (!overlaps(node)) {
+            continue;
+        }
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = &node - nodes.data() + 1;
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            if (inside(simulation.get_physics(order[i]).position)) {
+                out.push_back(order[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <vector>
+
+// Bounding volume hierarchy over the bodies' spheres, used to pick the
+// body under the cursor and to select bodies inside a screen rectangle.
+// The tree is rebuilt when bodies are added or removed, and otherwise
+// refit to the bodies' new positions each frame, which is much cheaper.
+class BodyBVH {
+public:
+    void update(const Simulation& simulation);
+
+    // Index of the body with the nearest hit in front of the ray
+    // origin, or Simulation::NO_INDEX if the ray hits nothing
+    int pick(const Simulation& simulation,
+             glm::vec3 origin, glm::vec3 direction) const;
+
+    // Indices of all bodies whose centre is inside the frustum, given as
+    // planes (xyz = normal pointing inwards, w = distance)
+    void select(const Simulation& simulation,
+                const std::array<glm::vec4, 5>& planes,
+                std::vector<int>& out) const;
+
+private:
+    static constexpr int LEAF_SIZE = 4;
+
+    // Nodes are stored depth first, so the left child of an inner
+    // node directly follows it and only the right child is stored.
+    // Leaves refer to a range of the order array.
+    struct Node {
+        glm::vec3 min;
+        int first;     // Leaf: first entry in order, inner: right child
+        glm::vec3 max;
+        int count;     // Leaf: number of bodies, inner: 0
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> order;
+    uint64_t built_version = UINT64_MAX;
+    float built_area = 0.0f;
+
+    void build(const Simulation& simulation);
+    int build_range(const Simulation& simulation, int begin, int end);
+    float refit(const Simulation& simulation);
+};
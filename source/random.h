@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Counter based random stream (splitmix64). Each stream is seeded from
+// a seed and a stream number, e.g. a body's index, so that streams can
+// be drawn from in any order on any thread and still come out the same.
+class Random {
+    uint64_t state;
+
+    static uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+public:
+    Random(uint64_t seed, uint64_t stream)
+    : state(mix(seed) ^ mix(stream + 0x9e3779b97f4a7c15ull))
+    {}
+
+    uint64_t next()
+    {
+        state += 0x9e3779b97f4a7c15ull;
+        return mix(state);
+    }
+
+    // Uniform in (0, 1]
+    float uniform()
+    {
+        return ((next() >> 40) + 1) * (1.0f / 16777216.0f);
+    }
+
+    float uniform(float min, float max)
+    {
+        return min + (max - min) * uniform();
+    }
+
+    float normal()
+    {
+        float u = uniform();
+        float v = uniform();
+        return std::sqrt(-2.0f * std::log(u))
+             * std::cos(glm::two_pi<float>() * v);
+    }
+
+    glm::vec3 unit_vector()
+    {
+        float z   = uniform(-1.0f, 1.0f);
+        float phi = uniform(0.0f, glm::two_pi<float>());
+        float r   = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        return glm::vec3(r * std::cos(phi), z, r * std::sin(phi));
+    }
+};
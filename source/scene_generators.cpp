@@ -0,0 +1,401 @@
+#include "scene_generators.h"
+#include "parallel.h"
+#include "random.h"
+
+#include <glm/gtc/constants.hpp>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Random streams are offset per sub-scene so that e.g. the two galaxies
+// in a collision don't mirror each other.
+constexpr uint64_t STREAM_STRIDE = 1ull << 40;
+
+// The bodies being generated, and the prefix of each one's name. The
+// names are numbered and interned once every body has been generated.
+struct NewBodies {
+    Simulation& simulation;
+    int first;
+    std::vector<const char*> prefixes;
+};
+
+void set_body(NewBodies& bodies, int index,
+              const char *prefix,
+              glm::vec3 position, glm::vec3 velocity,
+              float mass, float radius,
+              glm::vec3 colour, bool emits_light)
+{
+    auto& physics  = bodies.simulation.body_physics[index];
+    auto& instance = bodies.simulation.body_instance[index];
+    auto& info     = bodies.simulation.body_info[index];
+
+    physics.position      = position;
+    physics.velocity      = velocity;
+    physics.orig_position = position;
+    physics.orig_velocity = velocity;
+    physics.mass          = mass;
+    physics.radius        = radius;
+
+    instance.model       = glm::mat4(1.0f);
+    instance.colour      = colour;
+    instance.emits_light = emits_light;
+
+    // Names are interned afterwards on a single thread, see name_bodies
+    bodies.prefixes[index - bodies.first] = prefix;
+    info.tracers.clear();
+}
+
+glm::vec3 star_colour(Random& random)
+{
+    // Blend between a warm and a cool star colour
+    constexpr glm::vec3 WARM(1.0f, 0.7f, 0.4f);
+    constexpr glm::vec3 COOL(0.6f, 0.7f, 1.0f);
+    float t = random.uniform();
+    return WARM + (COOL - WARM) * t;
+}
+
+// Remove any net drift, so the scene stays centred on the origin
+void recentre(Simulation& simulation, int first, int count)
+{
+    glm::vec3 position(0.0f);
+    glm::vec3 velocity(0.0f);
+    float total = 0.0f;
+
+    for (int i = first; i < first + count; ++i) {
+        const auto& physics = simulation.body_physics[i];
+        position += physics.position * physics.mass;
+        velocity += physics.velocity * physics.mass;
+        total    += physics.mass;
+    }
+
+    position /= total;
+    velocity /= total;
+
+    for (int i = first; i < first + count; ++i) {
+        auto& physics = simulation.body_physics[i];
+        physics.position     -= position;
+        physics.velocity     -= velocity;
+        physics.orig_position = physics.position;
+        physics.orig_velocity = physics.velocity;
+    }
+}
+
+void generate_plummer(NewBodies& bodies, int first,
+                      const SceneParameters& params)
+{
+    const float a = params.scale;
+    const float m = params.mass / params.count;
+    const float radius = a * 0.005f;
+
+    parallel_for(params.count, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            Random random(params.seed, i);
+
+            // Invert the cumulative mass profile, cutting off the
+            // sparse outer halo so the scene stays compact
+            float r;
+            do {
+                float u = random.uniform();
+                r = a / std::sqrt(std::pow(u, -2.0f / 3.0f) - 1.0f);
+            } while (!std::isfinite(r) || r > 10.0f * a);
+
+            // Rejection sample the speed as a fraction of escape speed
+            float q, y;
+            do {
+                q = random.uniform();
+                y = random.uniform(0.0f, 0.1f);
+            } while (y > q * q * std::pow(1.0f - q * q, 3.5f));
+
+            float v_escape = std::sqrt(2.0f * GRAV_CONSTANT * params.mass)
+                           * std::pow(r * r + a * a, -0.25f);
+
+            set_body(bodies, first + i, "Star ",
+                     r * random.unit_vector(),
+                     q * v_escape * random.unit_vector(),
+                     m, radius, star_colour(random), false);
+        }
+    });
+
+    recentre(bodies.simulation, first, params.count);
+}
+
+// Exponential disc around a massive core. The core is the first body
+// of the range and the rest of the bodies orbit it in the disc plane.
+void generate_disc(NewBodies& bodies, int first, int count,
+                   const SceneParameters& params, uint64_t stream,
+                   glm::vec3 centre, glm::vec3 velocity, glm::vec3 normal)
+{
+    constexpr float CORE_FRACTION = 0.3f;
+    const float scale_length = params.scale / 4.0f;
+    const float core_mass    = params.mass * CORE_FRACTION;
+    const float disc_mass    = params.mass - core_mass;
+    const float m            = disc_mass / std::max(1, count - 1);
+    const float radius       = params.scale * 0.005f;
+
+    // Basis for the disc plane
+    normal = glm::normalize(normal);
+    auto helper = std::abs(normal.x) < 0.9f
+        ? glm::vec3(1.0f, 0.0f, 0.0f)
+        : glm::vec3(0.0f, 0.0f, 1.0f);
+    auto e1 = glm::normalize(glm::cross(normal, helper));
+    auto e2 = glm::cross(normal, e1);
+
+    set_body(bodies, first, "Core ", centre, velocity,
+             core_mass, radius * 8.0f, glm::vec3(1.0f, 0.9f, 0.7f), true);
+
+    parallel_for(count - 1, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            Random random(params.seed, stream + i);
+
+            // The radius of an exponential disc follows a gamma(2)
+            // distribution, the sum of two exponential samples
+            float r;
+            do {
+                r = -scale_length * std::log(random.uniform() * random.uniform());
+            } while (r < 0.1f * scale_length || r > 6.0f * scale_length);
+
+            float phi    = random.uniform(0.0f, glm::two_pi<float>());
+            float height = random.normal() * 0.02f * params.scale;
+
+            // Rotation curve from the mass enclosed within r
+            float x = r / scale_length;
+            float enclosed = core_mass
+                           + disc_mass * (1.0f - (1.0f + x) * std::exp(-x));
+            float speed = std::sqrt(GRAV_CONSTANT * enclosed / r);
+
+            auto radial     = std::cos(phi) * e1 + std::sin(phi) * e2;
+            auto tangential = -std::sin(phi) * e1 + std::cos(phi) * e2;
+            auto dispersion = random.unit_vector() * (0.05f * speed);
+
+            set_body(bodies, first + 1 + i, "Star ",
+                     centre + r * radial + height * normal,
+                     velocity + speed * tangential + dispersion,
+                     m, radius, star_colour(random), false);
+        }
+    });
+}
+
+void generate_collision(NewBodies& bodies, int first,
+                        const SceneParameters& params)
+{
+    // Two equal galaxies on a roughly parabolic approach,
+    // slightly offset and tilted relative to each other
+    int first_count  = params.count / 2;
+    int second_count = params.count - first_count;
+
+    float separation = params.scale * 3.0f;
+    float speed = 0.5f * std::sqrt(2.0f * GRAV_CONSTANT * params.mass / separation);
+
+    SceneParameters half = params;
+    half.mass = params.mass / 2.0f;
+
+    auto offset = glm::vec3(separation / 2.0f, params.scale * 0.5f, 0.0f);
+
+    generate_disc(bodies, first, first_count, half, 0,
+                  -offset, glm::vec3(speed, 0.0f, 0.0f),
+                  glm::vec3(0.0f, 1.0f, 0.0f));
+    generate_disc(bodies, first + first_count, second_count, half,
+                  STREAM_STRIDE,
+                  offset, glm::vec3(-speed, 0.0f, 0.0f),
+                  glm::vec3(0.5f, 1.0f, 0.3f));
+}
+
+void generate_cube(NewBodies& bodies, int first,
+                   const SceneParameters& params)
+{
+    // A cold uniform cube, which collapses under its own gravity
+    const float m = params.mass / params.count;
+    const float radius = params.scale * 0.005f;
+
+    parallel_for(params.count, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            Random random(params.seed, i);
+            glm::vec3 position(
+                random.uniform(-params.scale, params.scale),
+                random.uniform(-params.scale, params.scale),
+                random.uniform(-params.scale, params.scale));
+
+            set_body(bodies, first + i, "Body ",
+                     position, glm::vec3(0.0f),
+                     m, radius, star_colour(random), false);
+        }
+    });
+
+    recentre(bodies.simulation, first, params.count);
+}
+
+// Each solar system is a star, followed by planets each with one moon
+constexpr int PLANETS = 4;
+constexpr int BODIES_PER_SYSTEM = 1 + PLANETS * 2;
+
+void generate_solar_systems(NewBodies& bodies, int first,
+                            const SceneParameters& params)
+{
+    constexpr float PLANET_MASS_RATIO = 1e-3f;
+    constexpr float MOON_MASS_RATIO   = 1e-2f;
+
+    const int   systems     = std::max(1, params.count / BODIES_PER_SYSTEM);
+    const float star_mass   = params.mass / systems;
+    const float planet_mass = star_mass * PLANET_MASS_RATIO;
+    const float moon_mass   = planet_mass * MOON_MASS_RATIO;
+    const float cluster     = params.scale * 2.0f * std::cbrt(float(systems));
+    const float dispersion  = 0.3f * std::sqrt(
+        GRAV_CONSTANT * params.mass / cluster);
+
+    struct Orbit {
+        glm::vec3 position;
+        glm::vec3 velocity;
+        glm::vec3 e1, e2;
+        float radius;
+    };
+
+    // Circular orbit of given radius around a parent in a
+    // slightly inclined plane, derived from its own stream
+    auto orbit = [&](uint64_t stream, glm::vec3 parent_pos,
+                     glm::vec3 parent_vel, float parent_mass, float r) {
+        Random random(params.seed, stream);
+        auto normal = glm::normalize(
+            glm::vec3(0.0f, 1.0f, 0.0f) + 0.05f * random.unit_vector());
+        auto e1  = glm::normalize(glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)));
+        auto e2  = glm::cross(normal, e1);
+        float phi   = random.uniform(0.0f, glm::two_pi<float>());
+        float speed = std::sqrt(GRAV_CONSTANT * parent_mass / r);
+        auto radial     = std::cos(phi) * e1 + std::sin(phi) * e2;
+        auto tangential = -std::sin(phi) * e1 + std::cos(phi) * e2;
+        return Orbit {
+            parent_pos + r * radial,
+            parent_vel + speed * tangential,
+            e1, e2, r
+        };
+    };
+
+    parallel_for(params.count, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            int system = i / BODIES_PER_SYSTEM;
+            int member = i % BODIES_PER_SYSTEM;
+            uint64_t system_stream = uint64_t(system) * BODIES_PER_SYSTEM;
+
+            Random star_random(params.seed, system_stream);
+            auto star_pos = cluster * std::cbrt(star_random.uniform())
+                          * star_random.unit_vector();
+            auto star_vel = dispersion * star_random.normal()
+                          * star_random.unit_vector();
+
+            if (member == 0) {
+                set_body(bodies, first + i, "Star ",
+                         star_pos, star_vel, star_mass, params.scale * 0.05f,
+                         star_colour(star_random), true);
+                continue;
+            }
+
+            // Planets are spaced geometrically, moons sit well
+            // inside their planet's Hill sphere
+            int planet = (member - 1) / 2;
+            float planet_r = params.scale * 0.2f * std::pow(1.6f, planet);
+            float hill_r   = planet_r * std::cbrt(PLANET_MASS_RATIO / 3.0f);
+            float moon_r   = hill_r * 0.35f;
+
+            auto p = orbit(system_stream + 1 + planet,
+                           star_pos, star_vel, star_mass, planet_r);
+
+            if (member % 2 == 1) {
+                set_body(bodies, first + i, "Planet ",
+                         p.position, p.velocity, planet_mass, moon_r * 0.3f,
+                         glm::vec3(0.3f, 0.5f, 0.9f), false);
+            } else {
+                auto m = orbit(system_stream + 1 + PLANETS + planet,
+                               p.position, p.velocity, planet_mass, moon_r);
+                set_body(bodies, first + i, "Moon ",
+                         m.position, m.velocity, moon_mass, moon_r * 0.1f,
+                         glm::vec3(0.6f), false);
+            }
+        }
+    });
+}
+
+// Names the body "<prefix><number>" without a temporary string
+void name_body(Simulation& simulation, int index, const char *prefix, int number)
+{
+    char buffer[64];
+    auto length = std::min(std::strlen(prefix), sizeof(buffer) - 16);
+    std::memcpy(buffer, prefix, length);
+    auto end = std::to_chars(buffer + length, std::end(buffer), number).ptr;
+    simulation.set_name(index, std::string_view(buffer, end - buffer));
+}
+
+void generate(NewBodies& bodies, int first, const SceneParameters& params)
+{
+    switch (params.type) {
+    case SceneType::PlummerSphere:
+        generate_plummer(bodies, first, params);
+        break;
+    case SceneType::DiscGalaxy:
+        generate_disc(bodies, first, params.count, params, 0,
+                      glm::vec3(0.0f), glm::vec3(0.0f),
+                      glm::vec3(0.0f, 1.0f, 0.0f));
+        break;
+    case SceneType::CollidingGalaxies:
+        generate_collision(bodies, first, params);
+        break;
+    case SceneType::UniformCube:
+        generate_cube(bodies, first, params);
+        break;
+    case SceneType::SolarSystems:
+        generate_solar_systems(bodies, first, params);
+        break;
+    }
+}
+
+}
+
+void name_bodies(Simulation& simulation, int first, 
+                 std::span<const char *const> prefixes, int number)
+{
+    int offset = number < 0 ? 0 : number - first;
+    for (int i = 0; i < int(prefixes.size()); ++i) {
+        name_body(simulation, first + i, prefixes[i], first + i + offset);
+    }
+}
+
+void name_bodies(Simulation& simulation, int first, int count,
+                 const char *prefix, int number)
+{
+    int offset = number < 0 ? 0 : number - first;
+    for (int i = first; i < first + count; ++i) {
+        name_body(simulation, i, prefix, i + offset);
+    }
+}
+
+void generate_scene(Simulation& simulation, const SceneParameters& params)
+{
+    if (params.count <= 0) {
+        return;
+    }
+
+    // Solar systems only come in whole systems
+    SceneParameters adjusted = params;
+    if (params.type == SceneType::SolarSystems 
+        && params.count > BODIES_PER_SYSTEM) {
+        adjusted.count -= params.count % BODIES_PER_SYSTEM;
+    }
+
+    int first = simulation.append_bodies(adjusted.count);
+    NewBodies bodies { simulation, first, 
+                       std::vector<const char*>(adjusted.count) };
+    generate(bodies, first, adjusted);
+    name_bodies(simulation, first, bodies.prefixes);
+}
+
+bool parse_scene_type(const char *name, SceneType& type)
+{
+    for (int i = 0; i < int(std::size(SCENE_TYPE_NAMES)); ++i) {
+        if (std::strcmp(name, SCENE_TYPE_NAMES[i]) == 0) {
+            type = SceneType(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <cstdint>
+#include <span>
+
+enum class SceneType {
+    PlummerSphere,
+    DiscGalaxy,
+    CollidingGalaxies,
+    UniformCube,
+    SolarSystems
+};
+
+constexpr const char *SCENE_TYPE_NAMES[] = {
+    "plummer", "disc", "collision", "cube", "solar"
+};
+
+struct SceneParameters {
+    SceneType type = SceneType::PlummerSphere;
+    int count = 10000;
+    uint64_t seed = 1;
+    float scale = 50.0f;      // Characteristic radius of the scene
+    float mass = 1000.0f;     // Total mass of the scene
+};
+
+// Append a procedurally generated scene to the simulation. Bodies are
+// generated in parallel, and each body's random stream only depends on
+// the seed and its index, so the result is independent of thread count.
+void generate_scene(Simulation& simulation, const SceneParameters& params);
+
+// Names the bodies from first on "<prefix><index>", one prefix per
+// body, interned into the simulation's name arena. The numbers start 
+// from number instead of first if it's given.
+void name_bodies(Simulation& simulation, int first, 
+                 std::span<const char *const> prefixes, int number = -1);
+// The same, with one prefix for count bodies
+void name_bodies(Simulation& simulation, int first, int count,
+                 const char *prefix, int number = -1);
+
+bool parse_scene_type(const char *name, SceneType& type);
@@ -1,12 +1,88 @@
 #include "shader.h"
+#include "file_util.h"
 
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <iterator>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <filesystem>
 
 #include <GL/glew.h>
 
+#ifdef GRAVSIM_EMBED_SHADERS
+// Generated by scripts/embed_shaders.py, see make embedded
+struct EmbeddedShader {
+    const char *path;
+    const char *source;
+};
+
+static constexpr EmbeddedShader EMBEDDED_SHADERS[] = {
+#include "embedded_shaders.inc"
+};
+#endif
+
+// Identifies a cached program binary, followed by its format
+static constexpr char PROGRAM_CACHE_MAGIC[] = { 'G', 'S', 'P', 'B' };
+static constexpr size_t PROGRAM_CACHE_HEADER = sizeof(PROGRAM_CACHE_MAGIC) + sizeof(GLenum);
+
+static std::string default_cache_directory()
+{
+    if (const char *dir = std::getenv("GRAVSIM_SHADER_CACHE")) {
+        return dir;
+    }
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return std::string(xdg) + "/gravity-simulation";
+    }
+    if (const char *home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.cache/gravity-simulation";
+    }
+    return "";
+}
+
+std::string Shader::cache_directory = default_cache_directory();
+
+// The binary formats the driver accepts, none if it can't load binaries
+static const std::vector<int>& program_binary_formats()
+{
+    static std::vector<int> formats = [] {
+        int count = 0;
+        if (GLEW_ARB_get_program_binary) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        }
+        std::vector<int> formats(count);
+        if (count > 0) {
+            glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        }
+        return formats;
+    }();
+    return formats;
+}
+
+static bool program_binaries_supported()
+{
+    return !program_binary_formats().empty();
+}
+
+// From the embedded copy if there is one, else from the file
+static std::string read_shader_source(const char *path)
+{
+#ifdef GRAVSIM_EMBED_SHADERS
+    for (const auto& shader : EMBEDDED_SHADERS) {
+        if (std::strcmp(shader.path, path) == 0) {
+            return shader.source;
+        }
+    }
+#endif
+    std::ifstream ifs(path);
+    return std::string(std::istreambuf_iterator<char>{ifs}, 
+                       std::istreambuf_iterator<char>{});
+}
+
 static void check_shader_errors(
     unsigned    shader_handle,
     const char *target,
@@ -28,14 +104,129 @@ static void check_shader_errors(
 
 
 Shader::Shader(const char *vert_path, const char *frag_path)
+: Shader({ vert_path }, { frag_path })
+{
+}
+
+Shader::Shader(std::initializer_list<const char*> vert_paths, 
+               std::initializer_list<const char*> frag_paths)
 {
+    build(vert_paths, frag_paths, {});
+}
+
+Shader::Shader(const char *vert_path, 
+               std::initializer_list<const char*> feedback_varyings)
+{
+    build({ vert_path }, {}, feedback_varyings);
+}
+
+void Shader::build(std::initializer_list<const char*> vert_paths,
+                   std::initializer_list<const char*> frag_paths,
+                   std::initializer_list<const char*> feedback_varyings)
+{
+    vert_handle = 0;
+    frag_handle = 0;
+
+    // A cached program is only reused if it was built from the same
+    // sources, by the same driver
+    std::string cache_path;
+    if (!cache_directory.empty() && program_binaries_supported()) {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&](std::string_view text) {
+            for (char c : text) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+            hash = (hash ^ 0xff) * 1099511628211ull;
+        };
+        for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            auto value = glGetString(name);
+            mix(value ? reinterpret_cast<const char*>(value) : "");
+        }
+        for (auto stage : { vert_paths, frag_paths }) {
+            for (auto path : stage) {
+                mix(read_shader_source(path));
+            }
+            mix("stage");
+        }
+        for (auto varying : feedback_varyings) {
+            mix(varying);
+        }
+
+        char name[17];
+        auto end = std::to_chars(name, name + 16, hash, 16).ptr;
+        cache_path = cache_directory + "/" + std::string(name, end) + ".bin";
+        if (load_cached_program(cache_path)) {
+            return;
+        }
+    }
+
     vert_handle = glCreateShader(GL_VERTEX_SHADER);
-    frag_handle = glCreateShader(GL_FRAGMENT_SHADER);
+    load_and_compile(vert_paths, vert_handle);
+    if (frag_paths.size() > 0) {
+        frag_handle = glCreateShader(GL_FRAGMENT_SHADER);
+        load_and_compile(frag_paths, frag_handle);
+    }
+    compile_program(vert_handle, frag_handle, feedback_varyings);
+
+    if (!cache_path.empty()) {
+        save_cached_program(cache_path);
+    }
+}
+
+bool Shader::load_cached_program(const std::string& cache_path)
+{
+    std::ifstream file(cache_path, std::ios::binary);
+    std::string data(std::istreambuf_iterator<char>{file}, 
+                     std::istreambuf_iterator<char>{});
+    if (data.size() <= PROGRAM_CACHE_HEADER
+        || std::memcmp(data.data(), PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0) {
+        return false;
+    }
+
+    GLenum format;
+    std::memcpy(&format, data.data() + sizeof(PROGRAM_CACHE_MAGIC), sizeof(format));
+    const auto& formats = program_binary_formats();
+    if (std::find(formats.begin(), formats.end(), int(format)) == formats.end()) {
+        return false;
+    }
+    handle = glCreateProgram();
+    glProgramBinary(handle, format, data.data() + PROGRAM_CACHE_HEADER, 
+                    data.size() - PROGRAM_CACHE_HEADER);
+
+    // Drivers reject binaries they can no longer use, e.g. after an
+    // update, in which case the program is compiled again
+    int linked = 0;
+    glGetProgramiv(handle, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(handle);
+        handle = 0;
+        return false;
+    }
+
+    reflect_uniforms();
+    return true;
+}
+
+void Shader::save_cached_program(const std::string& cache_path) const
+{
+    int linked = 0;
+    int length = 0;
+    glGetProgramiv(handle, GL_LINK_STATUS, &linked);
+    glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!linked || length <= 0) {
+        return;
+    }
 
-    load_and_compile(vert_path, vert_handle);
-    load_and_compile(frag_path, frag_handle);
+    std::string data(PROGRAM_CACHE_HEADER + length, '\0');
+    GLenum format;
+    glGetProgramBinary(handle, length, nullptr, &format, data.data() + PROGRAM_CACHE_HEADER);
+    std::memcpy(data.data(), PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    std::memcpy(data.data() + sizeof(PROGRAM_CACHE_MAGIC), &format, sizeof(format));
 
-    compile_program(vert_handle, frag_handle);
+    // The cache is only an optimisation, so failures are ignored
+    std::error_code error;
+    std::filesystem::create_directories(cache_directory, error);
+    write_file_atomically(cache_path, data);
 }
 
 Shader::~Shader()
@@ -45,28 +236,56 @@ Shader::~Shader()
     glDeleteProgram(handle);
 }
 
-void Shader::load_and_compile(const char *path, unsigned shader_handle) const
+void Shader::load_and_compile(std::initializer_list<const char*> paths, 
+                              unsigned shader_handle) const
 {
-    std::ifstream ifs(path);
-    std::string src(std::istreambuf_iterator<char>{ifs}, {});
-    const char *csrc = src.c_str();
+    // The files are compiled as one source, in order, 
+    // so only the first should have a #version line
+    std::vector<std::string> sources;
+    std::vector<const char*> csources;
+    std::string target;
+
+    for (auto path : paths) {
+        sources.push_back(read_shader_source(path));
+        target += (target.empty() ? "" : " + ") + std::string(path);
+    }
+    for (const auto& src : sources) {
+        csources.push_back(src.c_str());
+    }
 
-    glShaderSource(shader_handle, 1, &csrc, NULL);
+    glShaderSource(shader_handle, csources.size(), csources.data(), NULL);
     glCompileShader(shader_handle);
 
     check_shader_errors(
         shader_handle, 
-        path, 
+        target.c_str(), 
         glGetShaderiv, 
         glGetShaderInfoLog, 
         GL_COMPILE_STATUS);
 }
 
-void Shader::compile_program(unsigned v_handle, unsigned f_handle)
+void Shader::compile_program(unsigned v_handle, unsigned f_handle,
+                             std::initializer_list<const char*> feedback_varyings)
 {
     handle = glCreateProgram();
     glAttachShader(handle, v_handle);
-    glAttachShader(handle, f_handle);
+    if (f_handle != 0) {
+        glAttachShader(handle, f_handle);
+    }
+
+    // Transform feedback outputs have to be chosen before linking.
+    // Each goes to its own buffer binding, in the order given.
+    if (feedback_varyings.size() > 0) {
+        std::vector<const char*> names(feedback_varyings);
+        glTransformFeedbackVaryings(
+            handle, names.size(), names.data(), GL_SEPARATE_ATTRIBS);
+    }
+
+    // Lets the linked program be saved to the cache
+    if (!cache_directory.empty() && program_binaries_supported()) {
+        glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glLinkProgram(handle);
 
     check_shader_errors(
@@ -75,6 +294,38 @@ void Shader::compile_program(unsigned v_handle, unsigned f_handle)
         glGetProgramiv, 
         glGetProgramInfoLog, 
         GL_LINK_STATUS);
+
+    reflect_uniforms();
+}
+
+void Shader::reflect_uniforms()
+{
+    int count = 0;
+    int max_length = 0;
+    glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+    std::string name(max_length, '\0');
+
+    for (int i = 0; i < count; ++i) {
+        int length, size;
+        GLenum type;
+        glGetActiveUniform(handle, i, max_length, &length, &size, &type, name.data());
+
+        // Members of uniform blocks have no location
+        std::string_view active(name.data(), length);
+        int loc = glGetUniformLocation(handle, name.c_str());
+        if (loc < 0) {
+            continue;
+        }
+
+        // Arrays are reported as "name[0]", so store the bare name too
+        locations.emplace(active, loc);
+        if (active.ends_with("[0]")) {
+            active.remove_suffix(3);
+            locations.emplace(active, loc);
+        }
+    }
 }
 
 void Shader::use() const 
@@ -82,34 +333,86 @@ void Shader::use() const
     glUseProgram(handle);
 }
 
+int Shader::location(std::string_view name) const
+{
+    auto found = locations.find(name);
+    return (found != locations.end()) ? found->second : -1;
+}
+
+void Shader::bind_block(const char *name, unsigned binding) const
+{
+    unsigned index = glGetUniformBlockIndex(handle, name);
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(handle, index, binding);
+    }
+}
+
 void Shader::uniform_int(const char* name, int value) const
 {
-    glUniform1i(glGetUniformLocation(handle, name), value);
+    uniform_int(location(name), value);
+}
+
+void Shader::uniform_ivec3(const char* name, const int* value) const
+{
+    uniform_ivec3(location(name), value);
 }
 
 void Shader::uniform_float(const char* name, float value) const
 {
-    glUniform1f(glGetUniformLocation(handle, name), value);
+    uniform_float(location(name), value);
 }
 
 void Shader::uniform_vec2(const char* name, const float* value) const
 {
-    glUniform2fv(glGetUniformLocation(handle, name), 1, value);
+    uniform_vec2(location(name), value);
 }
 
 void Shader::uniform_vec3(const char* name, const float* value) const
 {
-    glUniform3fv(glGetUniformLocation(handle, name), 1, value);
+    uniform_vec3(location(name), value);
 }
 
 void Shader::uniform_vec4(const char* name, const float* value) const
 {
-    glUniform4fv(glGetUniformLocation(handle, name), 1, value);
+    uniform_vec4(location(name), value);
 }
 
-void Shader::uniform_mat4(const char* name, float* value) const
+void Shader::uniform_mat4(const char* name, const float* value) const
 {
-    int location = glGetUniformLocation(handle, name);
-    glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    uniform_mat4(location(name), value);
+}
+
+void Shader::uniform_int(int location, int value) const
+{
+    glUniform1i(location, value);
+}
+
+void Shader::uniform_ivec3(int location, const int* value) const
+{
+    glUniform3iv(location, 1, value);
+}
+
+void Shader::uniform_float(int location, float value) const
+{
+    glUniform1f(location, value);
 }
 
+void Shader::uniform_vec2(int location, const float* value) const
+{
+    glUniform2fv(location, 1, value);
+}
+
+void Shader::uniform_vec3(int location, const float* value) const
+{
+    glUniform3fv(location, 1, value);
+}
+
+void Shader::uniform_vec4(int location, const float* value) const
+{
+    glUniform4fv(location, 1, value);
+}
+
+void Shader::uniform_mat4(int location, const float* value) const
+{
+    glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
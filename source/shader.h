@@ -2,27 +2,80 @@
 #define __SHADER_H
 
 #include <string>
+#include <string_view>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
 #include <iostream>
 
 class Shader {
+    // Lets the location table be searched with a string_view,
+    // so looking up a uniform by name never allocates
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const
+        {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
     unsigned handle;
     unsigned vert_handle;
     unsigned frag_handle;
+    std::unordered_map<std::string, int, NameHash, std::equal_to<>> locations;
 
 public:
     Shader(const char *vert_path, const char *frag_path);
+    // Each stage may be split over several files, e.g. to share functions
+    Shader(std::initializer_list<const char*> vert_paths, 
+           std::initializer_list<const char*> frag_paths);
+    // A vertex only program whose outputs are captured with transform 
+    // feedback, for computing on the GPU with rasterisation disabled
+    Shader(const char *vert_path, 
+           std::initializer_list<const char*> feedback_varyings);
     ~Shader();
+
+    // Where linked programs are cached between runs, so later launches
+    // skip compiling. Empty disables the cache. Defaults to the user's
+    // cache directory, or GRAVSIM_SHADER_CACHE if set.
+    static std::string cache_directory;
+
+    // Locations of the active uniforms are read once when the program is
+    // linked. Unknown names give -1, which OpenGL silently ignores.
+    int location(std::string_view name) const;
+    // Binds a uniform block to a buffer binding point, if the shader uses it
+    void bind_block(const char *name, unsigned binding) const;
+
     void uniform_int(const char *name, int value) const;
+    void uniform_ivec3(const char *name, const int *value) const;
     void uniform_float(const char *name, float value) const;
     void uniform_vec2(const char *name, const float *value) const;
     void uniform_vec3(const char *name, const float *value) const;
     void uniform_vec4(const char *name, const float *value) const;
-    void uniform_mat4(const char* name, float* value) const;
+    void uniform_mat4(const char *name, const float *value) const;
+
+    void uniform_int(int location, int value) const;
+    void uniform_ivec3(int location, const int *value) const;
+    void uniform_float(int location, float value) const;
+    void uniform_vec2(int location, const float *value) const;
+    void uniform_vec3(int location, const float *value) const;
+    void uniform_vec4(int location, const float *value) const;
+    void uniform_mat4(int location, const float *value) const;
     void use() const;
 
 private:
-    void load_and_compile(const char *path, unsigned shader_handle) const;
-    void compile_program(unsigned v_handle, unsigned f_handle);
+    void build(std::initializer_list<const char*> vert_paths,
+               std::initializer_list<const char*> frag_paths,
+               std::initializer_list<const char*> feedback_varyings);
+    void reflect_uniforms();
+    void load_and_compile(std::initializer_list<const char*> paths, 
+                          unsigned shader_handle) const;
+    void compile_program(unsigned v_handle, unsigned f_handle,
+                         std::initializer_list<const char*> feedback_varyings = {});
+    // Programs are cached by a hash of their sources and the driver
+    bool load_cached_program(const std::string& cache_path);
+    void save_cached_program(const std::string& cache_path) const;
     void log_error(int error_type, unsigned shader, const char *target) const;
 };
 #endif
@@ -1,8 +1,15 @@
 #include "simulation.h"
+#include "file_util.h"
+#include "small_kernels.h"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 #include <iostream>
+#include <cmath>
+#include <cstring>
+#include <chrono>
 #include <fstream>
+#include <sstream>
 
 const BodyInfo& Simulation::get_info(int index) const
 {
@@ -10,52 +17,302 @@ const BodyInfo& Simulation::get_info(int index) const
         "NONE", {}
     };
 
-    return (index == NO_BODY)
+    return (index == NO_INDEX)
         ? dummy_info
         : body_info[index];
 }
 
+const BodyInfo& Simulation::get_info(BodyHandle handle) const
+{
+    return get_info(index_of(handle));
+}
+
 const BodyPhysics& Simulation::get_physics(int index) const
 {
     static const BodyPhysics dummy_physics;
 
-    return (index == NO_BODY)
+    return (index == NO_INDEX)
         ? dummy_physics
         : body_physics[index];
 }
 
+const BodyPhysics& Simulation::get_physics(BodyHandle handle) const
+{
+    return get_physics(index_of(handle));
+}
+
 const BodyInstance& Simulation::get_instance(int index) const
 {
     return body_instance[index];
 }
 
+int Simulation::index_of(BodyHandle handle) const
+{
+    if (handle.slot >= body_slots.size()) {
+        return NO_INDEX;
+    }
+
+    const auto& slot = body_slots[handle.slot];
+    return (slot.generation == handle.generation)
+        ? slot.index
+        : NO_INDEX;
+}
+
+BodyHandle Simulation::handle_of(int index) const
+{
+    if (index == NO_INDEX) {
+        return NO_BODY;
+    }
+
+    uint32_t slot = slot_of_body[index];
+    return BodyHandle{ slot, body_slots[slot].generation };
+}
+
+uint32_t Simulation::allocate_slot(uint32_t index)
+{
+    // Reuse a freed slot if there is one, keeping its generation
+    if (free_slot != NO_SLOT) {
+        uint32_t slot = free_slot;
+        free_slot = body_slots[slot].index;
+        body_slots[slot].index = index;
+        return slot;
+    }
+
+    body_slots.push_back(BodySlot{ index, 0 });
+    return body_slots.size() - 1;
+}
+
+BodyHandle Simulation::add_body(const BodyInfo&     info,
+                                const BodyPhysics&  physics,
+                                const BodyInstance& instance)
+{
+    body_info.push_back(info);
+    body_info.back().name = names.intern(info.name);
+    live_name_bytes += info.name.size() + 1;
+    body_physics.push_back(physics);
+    body_instance.push_back(instance);
+    slot_of_body.push_back(allocate_slot(num_bodies));
+    ++body_version;
+
+    return handle_of(num_bodies++);
+}
+
+int Simulation::append_bodies(int count)
+{
+    // Grow the body arrays by count default bodies, to be filled in
+    // directly by the caller. Returns the index of the first new body.
+    int first = num_bodies;
+    num_bodies += count;
+
+    // Unnamed until the caller names them, but still pointing into 
+    // the arena. The empty name is shared, but counted for each body
+    // as compacting gives each its own.
+    body_info.resize(num_bodies, BodyInfo{ names.intern({}), {} });
+    live_name_bytes += count;
+    body_physics.resize(num_bodies);
+    body_instance.resize(num_bodies);
+    slot_of_body.reserve(num_bodies);
+
+    for (int i = first; i < num_bodies; ++i) {
+        slot_of_body.push_back(allocate_slot(i));
+    }
+
+    ++body_version;
+    return first;
+}
+
+void Simulation::set_name(int index, std::string_view name)
+{
+    // Every body's name is counted, including its terminator
+    auto& info = body_info[index];
+    live_name_bytes -= info.name.size() + 1;
+
+    info.name = names.intern(name);
+    live_name_bytes += name.size() + 1;
+    ++body_version;
+
+    compact_names();
+}
+
+void Simulation::compact_names()
+{
+    // Only compact once most of the arena is unreachable
+    constexpr size_t MIN_COMPACT_SIZE = 1 << 20;
+    if (names.size() < MIN_COMPACT_SIZE || names.size() < 2 * live_name_bytes) {
+        return;
+    }
+
+    NameArena compacted;
+    for (auto& info : body_info) {
+        info.name = compacted.intern(info.name);
+    }
+    names = std::move(compacted);
+}
+
+glm::vec3 Simulation::tracer_origin() const
+{
+    return get_physics(draw_tracers_relative_to).position;
+}
+
+void append_tracer(BodyInfo& info, glm::vec3 point)
+{
+    // A new segment is started once the path turns more than this 
+    // from the current one. Bends are kept to within a fraction of a 
+    // degree's sag, so curves look the same, but escaping bodies 
+    // and wide orbits need a fraction of the points.
+    static const float MIN_COS_ANGLE = std::cos(glm::radians(2.0f));
+    constexpr float MIN_LENGTH = 1e-6f;
+
+    auto& tracers = info.tracers;
+    if (tracers.empty()) {
+        tracers.push_back(point);
+        return;
+    }
+
+    glm::vec3 anchor = (tracers.size() == 1) 
+        ? tracers.back() 
+        : tracers[tracers.size() - 2];
+    glm::vec3 chord  = point - anchor;
+    float length     = glm::length(chord);
+    if (length < MIN_LENGTH) {
+        return;
+    }
+
+    glm::vec3 direction = chord / length;
+    if (tracers.size() > 1 
+        && glm::dot(direction, info.tracer_direction) >= MIN_COS_ANGLE) {
+        tracers.back() = point;
+        return;
+    }
+
+    // Keep the end of the current segment and start a new one from it
+    glm::vec3 start = tracers.back();
+    tracers.push_back(point);
+    info.tracer_direction = glm::normalize(point - start);
+}
+
+// Adds a point to a running trail without allocating once it has
+// its capacity. A full trail drops every other point of its older 
+// half, so the oldest stretches are simplified again and again while
+// recent ones keep their detail. Each point is moved a few times at
+// most, as a quarter of the trail is freed each time.
+static void append_trail(BodyInfo& info, glm::vec3 point)
+{
+    constexpr size_t MAX_POINTS = Simulation::MAX_TRAIL_POINTS;
+    auto& tracers = info.tracers;
+    if (tracers.capacity() < MAX_POINTS) {
+        tracers.reserve(MAX_POINTS);
+    }
+    if (tracers.size() >= MAX_POINTS) {
+        // The first point stays, so the trail still starts where it did
+        size_t older = tracers.size() / 2;
+        size_t kept  = 1;
+        for (size_t i = 2; i < older; i += 2) {
+            tracers[kept++] = tracers[i];
+        }
+        auto end = std::copy(tracers.begin() + older, tracers.end(), 
+                             tracers.begin() + kept);
+        tracers.erase(end, tracers.end());
+        ++info.tracer_edits;
+    }
+    append_tracer(info, point);
+}
+
 void Simulation::clear_tracers()
 {
     for (int i = 0; i < num_bodies; ++i) {
         auto& info = body_info[i];
         info.tracers.clear();
+        ++info.tracer_edits;
     }
+    trajectories_valid = false;
 }
 
-void Simulation::delete_body(int index)
+void Simulation::remove_at(int index)
 {
-    if (index == draw_tracers_relative_to) {
-        draw_tracers_relative_to = NO_BODY;
+    // Swap the body with the last one and pop it, so removal doesn't 
+    // shift every following body. Only the moved body's slot changes.
+    int last = num_bodies - 1;
+    uint32_t removed_slot = slot_of_body[index];
+    uint32_t moved_slot   = slot_of_body[last];
+    live_name_bytes -= body_info[index].name.size() + 1;
+
+    if (index != last) {
+        body_info[index]     = std::move(body_info[last]);
+        body_physics[index]  = body_physics[last];
+        body_instance[index] = body_instance[last];
+        slot_of_body[index]  = moved_slot;
+        body_slots[moved_slot].index = index;
     }
 
-    body_info.erase(body_info.begin() + index);
-    body_physics.erase(body_physics.begin() + index);
-    body_instance.erase(body_instance.begin() + index);
+    body_info.pop_back();
+    body_physics.pop_back();
+    body_instance.pop_back();
+    slot_of_body.pop_back();
     --num_bodies;
+    ++body_version;
+
+    // Invalidate outstanding handles and put the slot on the free list
+    auto& slot = body_slots[removed_slot];
+    ++slot.generation;
+    slot.index = free_slot;
+    free_slot  = removed_slot;
+}
+
+void Simulation::delete_body(BodyHandle handle)
+{
+    int index = index_of(handle);
+    if (index == NO_INDEX) {
+        return;
+    }
+
+    if (handle == draw_tracers_relative_to) {
+        draw_tracers_relative_to = NO_BODY;
+    }
+
+    remove_at(index);
+}
+
+void Simulation::delete_bodies(const std::vector<BodyHandle>& handles)
+{
+    // Handles are resolved one at a time, since each removal 
+    // may move another body to a different index
+    for (auto handle : handles) {
+        delete_body(handle);
+    }
+}
+
+void Simulation::reset_handles()
+{
+    // Free every slot, bumping generations so that handles into the 
+    // previous set of bodies don't resolve to the new ones
+    free_slot = NO_SLOT;
+    for (uint32_t slot = body_slots.size(); slot-- > 0;) {
+        ++body_slots[slot].generation;
+        body_slots[slot].index = free_slot;
+        free_slot = slot;
+    }
+
+    slot_of_body.clear();
+    for (int i = 0; i < num_bodies; ++i) {
+        slot_of_body.push_back(allocate_slot(i));
+    }
+    draw_tracers_relative_to = NO_BODY;
+    ++body_version;
 }
 
-void update_forces(std::vector<BodyPhysics>& bodies, float time_step)
+void update_forces(std::span<BodyPhysics> bodies, float time_step)
 {
     constexpr float epsilon = 0.0001;
-    constexpr float grav_constant = 6.674e-3;
 
     int len = bodies.size();
 
+    // Small scenes have their own unrolled kernels
+    if (auto kernel = small_force_kernel(len)) {
+        kernel(bodies.data(), time_step);
+        return;
+    }
+
     for (int i = 0; i < len; ++i) {
         auto& body = bodies[i];
 
@@ -71,9 +328,9 @@ void update_forces(std::vector<BodyPhysics>& bodies, float time_step)
             float radius = glm::length(delta);
 
             // Avoid division by 0
-            if (abs(radius) > epsilon) {
+            if (std::abs(radius) > epsilon) {
                 float r2 = radius * radius;
-                float a  = (grav_constant * other.mass) / r2;
+                float a  = (GRAV_CONSTANT * other.mass) / r2;
                 // F = Gm1m2/r^2, F = ma, a = Gm/r^2
                 glm::vec3 acceleration = a * force_dir;
                 body.velocity += acceleration * time_step;
@@ -82,54 +339,146 @@ void update_forces(std::vector<BodyPhysics>& bodies, float time_step)
     }
 }
 
+uint64_t Simulation::trajectory_checksum() const
+{
+    // FNV-1a over everything the previews start from, a word at a time
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](const auto& value) {
+        static_assert(sizeof(value) % sizeof(uint32_t) == 0);
+        uint32_t words[sizeof(value) / sizeof(uint32_t)];
+        std::memcpy(words, &value, sizeof(value));
+        for (auto word : words) {
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+    };
+
+    mix(num_bodies);
+    mix(draw_tracers_relative_to);
+    mix(trajectory_settings);
+    mix(integrator_settings);
+    for (const auto& physics : body_physics) {
+        mix(physics.orig_position);
+        mix(physics.orig_velocity);
+        mix(physics.mass);
+    }
+    return hash;
+}
+
 void Simulation::calculate_trajectories()
 {
-    constexpr int precalc_steps = 1000;
-    constexpr int line_period = 10;
-
-    // Create a copy of the physics to update for trajectories
-    std::vector<BodyPhysics> copy;
-    std::copy(body_physics.begin(), 
-              body_physics.end(), 
-              std::back_inserter(copy));
-
-    for (int step = 0; step < precalc_steps; ++step) {
-        update_forces(copy, 1.0f);
-        for (int i = 0; i < num_bodies; ++i) {
-            auto& physics = copy[i];
-            physics.position += physics.velocity;
-            auto& info = body_info[i];
-            
-            // Ignore if drawing relative to this body, as tracers
-            // will all be the same as the body's position
-            if (i == draw_tracers_relative_to) {
-                continue;
-            }
+    using Clock = std::chrono::steady_clock;
+    const auto& settings = trajectory_settings;
+
+    // Start again from the current state whenever the bodies, the 
+    // relative body or the settings have changed
+    uint64_t checksum = trajectory_checksum();
+    if (!trajectories_valid || checksum != trajectory_source) {
+        trajectory_state.assign(body_physics.begin(), body_physics.end());
+        trajectory_step    = 0;
+        trajectory_source  = checksum;
+        trajectories_valid = true;
+
+        // The number of tracers is known up front, so this
+        // only allocates when the bodies or settings grow
+        int samples = (settings.horizon + settings.period - 1) / settings.period;
+        for (auto& info : body_info) {
+            info.tracers.clear();
+            info.tracers.reserve(samples);
+            ++info.tracer_edits;
+        }
+    }
 
-            // Trajectories may be drawn relative to a body,
-            // so subtract it's position for all tracers
-            glm::vec3 relative, relative_orig;
+    // The first steps appear immediately, so edits feel instant. 
+    // The rest are added until this update's budget runs out.
+    int immediate = std::min(TRAJECTORY_INITIAL_STEPS, settings.horizon);
+    auto budget   = std::chrono::duration<float, std::milli>(trajectory_budget_ms);
+    auto start    = Clock::now();
 
-            if (draw_tracers_relative_to == Simulation::NO_BODY) {
-                relative      = glm::vec3(0.0);
-                relative_orig = glm::vec3(0.0);
-            } else {
-                relative      = copy[draw_tracers_relative_to].position;
-                relative_orig = copy[draw_tracers_relative_to].orig_position;
-            }
-            
-            if (step % line_period == 0) {
-                auto tracer_pos = physics.position - (relative - relative_orig);
-                info.tracers.push_back(tracer_pos);
-            }
+    while (trajectory_step < settings.horizon) {
+        step_trajectories();
+
+        bool over_budget = trajectory_budget_ms > 0.0f
+                        && Clock::now() - start > budget;
+        if (trajectory_step >= immediate && over_budget) {
+            break;
+        }
+    }
+}
+
+void Simulation::step_trajectories()
+{
+    auto copy = std::span<BodyPhysics>(trajectory_state);
+    int relative_index = index_of(draw_tracers_relative_to);
+    int step = trajectory_step++;
+
+    step_bodies(copy);
+    for (int i = 0; i < num_bodies; ++i) {
+        auto& physics = copy[i];
+        auto& info = body_info[i];
+        
+        // Ignore if drawing relative to this body, as tracers
+        // will all be the same as the body's position
+        if (i == relative_index) {
+            continue;
         }
-    }    
+
+        // Trajectories may be drawn relative to a body,
+        // so subtract it's position for all tracers
+        glm::vec3 relative = (relative_index == Simulation::NO_INDEX)
+            ? glm::vec3(0.0)
+            : copy[relative_index].position;
+        
+        if (step % trajectory_settings.period == 0) {
+            append_tracer(info, physics.position - relative);
+        }
+    }
+}
+
+int Simulation::integrator_central_body() const
+{
+    auto type = integrator_settings.type;
+    if (type == IntegratorType::Euler || num_bodies < 2) {
+        return NO_INDEX;
+    }
+
+    int heaviest = 0;
+    double total_mass = 0.0;
+    for (int i = 0; i < num_bodies; ++i) {
+        float mass = body_physics[i].mass;
+        total_mass += mass;
+        if (mass > body_physics[heaviest].mass) {
+            heaviest = i;
+        }
+    }
+
+    double central_mass = body_physics[heaviest].mass;
+    bool dominant = central_mass >= DOMINANT_MASS_RATIO * (total_mass - central_mass);
+    return (type == IntegratorType::WisdomHolman || dominant) 
+        ? heaviest 
+        : NO_INDEX;
+}
+
+void Simulation::step_bodies(std::span<BodyPhysics> bodies)
+{
+    float time_step = integrator_settings.time_step;
+    int central = integrator_central_body();
+    if (central != NO_INDEX && bodies[central].mass > 0.0f) {
+        wisdom_holman.step(bodies, central, time_step);
+        return;
+    }
+
+    update_forces(bodies, time_step);
+    for (auto& physics : bodies) {
+        physics.position += physics.velocity * time_step;
+    }
 }
 
 void Simulation::update_positions()
 {
     constexpr int trail_period = 10;
-    auto relative_vel = get_physics(draw_tracers_relative_to).velocity;
+    // Trails are kept relative to the relative body, so 
+    // that they follow it without being moved
+    auto relative_pos = tracer_origin();
 
     for (int i = 0; i < num_bodies; ++i) {
         auto& info     = body_info[i];
@@ -137,19 +486,12 @@ void Simulation::update_positions()
         auto& instance = body_instance[i];
 
         if (state == SimulationState::Running) {
-            // Adjust the tracers to be in line with the relative body
-            for (auto& tracer_vert : info.tracers) {
-                tracer_vert += relative_vel;
+            if (record_tracers && num_updates % trail_period == 0) {
+                append_trail(info, physics.position - relative_pos);
             }
-
-            if (num_updates % trail_period == 0) {
-                info.tracers.push_back(physics.position);
-            }
-
-            physics.position += physics.velocity;
         } else if (state == SimulationState::Waiting) {
-            // Clear the tracers and reset the velocity and position
-            info.tracers.clear();
+            // Reset the velocity and position. The tracers are kept, 
+            // as the previews are extended across updates.
             physics.position = physics.orig_position;
             physics.velocity = physics.orig_velocity;
         }
@@ -165,72 +507,233 @@ void Simulation::update()
 {
     // Update the physics 
     if (state == SimulationState::Running) {
-        update_forces(body_physics, 1.0f);
+        step_bodies(body_physics);
     }
 
     update_positions();
 
-    if (state == SimulationState::Waiting) {
+    if (state == SimulationState::Waiting && compute_trajectories) {
         calculate_trajectories();
-    }    
+    } else {
+        // The tracers are trails or stale now
+        trajectories_valid = false;
+    }
 
     ++num_updates;
 }
 
-void Simulation::load_simulation(const std::string &path)
+// Mark the settings appended after the bodies in a .sim file
+static constexpr char TRAJECTORY_TAG[] = { 'T', 'R', 'A', 'J' };
+static constexpr char INTEGRATOR_TAG[] = { 'I', 'N', 'T', 'G' };
+
+bool read_snapshot(std::istream &file, SimulationSnapshot &snapshot,
+                   const std::atomic<bool> *cancel, std::atomic<float> *progress)
 {
-    std::ifstream file(path, std::ios::binary);
-    if (file.good()) {
-        auto read = [&]<typename T>() -> T {
-            T buf;
-            file.read(reinterpret_cast<char*>(&buf), sizeof(T));
-            return buf;
-        };
-        int count = read.operator()<int>();
-        std::vector<BodyPhysics> phys;
-        for (int _ = 0; _ < count; ++_) {
-            auto b = read.operator()<BodyPhysics>();
-            phys.push_back(b);
+    // Bodies are read a block at a time, to report progress, and so
+    // that a truncated file fails before much is allocated for it
+    constexpr int BLOCK_SIZE  = 1 << 16;
+    constexpr size_t MAX_NAME = 1 << 16;
+
+    auto read = [&]<typename T>() -> T {
+        T buf;
+        file.read(reinterpret_cast<char*>(&buf), sizeof(T));
+        return buf;
+    };
+    int count = read.operator()<int>();
+    if (!file || count < 0) {
+        return false;
+    }
+
+    auto cancelled = [&] { 
+        return cancel && cancel->load(std::memory_order_relaxed); 
+    };
+    auto report = [&](int part, int done) {
+        if (progress) {
+            progress->store((part * double(count) + done) / (3.0 * std::max(count, 1)));
+        }
+    };
+    auto read_array = [&](auto &array, int part) {
+        using T = typename std::remove_reference_t<decltype(array)>::value_type;
+        array.clear();
+        for (int first = 0; first < count; first += BLOCK_SIZE) {
+            int block = std::min(BLOCK_SIZE, count - first);
+            array.resize(first + block);
+            file.read(reinterpret_cast<char*>(array.data() + first), sizeof(T) * block);
+            if (!file || cancelled()) {
+                return false;
+            }
+            report(part, first + block);
+        }
+        return true;
+    };
+    if (!read_array(snapshot.body_physics, 0) || !read_array(snapshot.body_instance, 1)) {
+        return false;
+    }
+
+    snapshot.body_info.clear();
+    snapshot.body_info.reserve(count);
+    snapshot.names.clear();
+    std::string name;
+    for (int i = 0; i < count; ++i) {
+        auto len = read.operator()<size_t>();
+        if (!file || len > MAX_NAME) {
+            return false;
         }
-        std::vector<BodyInstance> inst;
-        for (int _ = 0; _ < count; ++_) {
-            auto i = read.operator()<BodyInstance>();
-            inst.push_back(i);
+        name.resize(len);
+        file.read(name.data(), len);
+        snapshot.body_info.push_back(BodyInfo{snapshot.names.intern(name), {}});
+
+        if (i % BLOCK_SIZE == 0) {
+            if (cancelled()) {
+                return false;
+            }
+            report(2, i);
         }
-        std::vector<BodyInfo> info;
-        for (int _i = 0; _i < count; ++_i) {
-            auto len = read.operator()<size_t>();
-            std::string name = "";
-            for (int _j = 0; _j < len; ++_j) {
-                name += read.operator()<char>();
+    }
+    if (!file) {
+        return false;
+    }
+
+    // Each group of settings follows a tag. Older files end 
+    // after the names, or are missing the later settings.
+    TrajectorySettings settings;
+    IntegratorSettings integrator;
+    char tag[sizeof(TRAJECTORY_TAG)];
+    while (file.read(tag, sizeof(tag))) {
+        if (std::memcmp(tag, TRAJECTORY_TAG, sizeof(tag)) == 0) {
+            settings = read.operator()<TrajectorySettings>();
+            settings.horizon = std::max(settings.horizon, 1);
+            settings.period  = std::max(settings.period, 1);
+        } else if (std::memcmp(tag, INTEGRATOR_TAG, sizeof(tag)) == 0) {
+            integrator = read.operator()<IntegratorSettings>();
+            int type = static_cast<int>(integrator.type);
+            if (type < 0 || type > static_cast<int>(IntegratorType::WisdomHolman)) {
+                integrator.type = IntegratorType::Automatic;
+            }
+            if (!(integrator.time_step > 0.0f)) {
+                integrator.time_step = 1.0f;
             }
-            info.push_back(BodyInfo{name});
+        } else {
+            break;
         }
+    }
+    snapshot.trajectory_settings = settings;
+    snapshot.integrator_settings = integrator;
+
+    report(3, 0);
+    return true;
+}
 
-        num_bodies = count;
-        body_info = info;
-        body_physics = phys;
-        body_instance = inst;
+// Writes the .sim format from a simulation or a snapshot
+template <typename Scene>
+static void write_scene(std::ostream &file, const Scene &scene)
+{
+    int count = scene.body_physics.size();
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(scene.body_physics.data()), 
+               sizeof(BodyPhysics) * count);
+    file.write(reinterpret_cast<const char*>(scene.body_instance.data()), 
+               sizeof(BodyInstance) * count);
+    for (auto &info : scene.body_info) {
+        auto &name = info.name;
+        auto len   = name.length();
+        file.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        file.write(name.data(), len);
     }
+    file.write(TRAJECTORY_TAG, sizeof(TRAJECTORY_TAG));
+    file.write(reinterpret_cast<const char*>(&scene.trajectory_settings), 
+               sizeof(scene.trajectory_settings));
+    file.write(INTEGRATOR_TAG, sizeof(INTEGRATOR_TAG));
+    file.write(reinterpret_cast<const char*>(&scene.integrator_settings), 
+               sizeof(scene.integrator_settings));
 }
 
-void Simulation::save_simulation(const std::string &path)
+void write_snapshot(std::ostream &file, const SimulationSnapshot &snapshot)
+{
+    write_scene(file, snapshot);
+}
+
+SimulationSnapshot Simulation::snapshot() const
+{
+    SimulationSnapshot snapshot;
+    snapshot.body_physics  = body_physics;
+    snapshot.body_instance = body_instance;
+    snapshot.body_info.resize(num_bodies);
+    for (int i = 0; i < num_bodies; ++i) {
+        snapshot.body_info[i].name = snapshot.names.intern(body_info[i].name);
+    }
+    snapshot.trajectory_settings = trajectory_settings;
+    snapshot.integrator_settings = integrator_settings;
+    return snapshot;
+}
+
+void Simulation::restore(SimulationSnapshot &&snapshot)
+{
+    num_bodies    = snapshot.body_physics.size();
+    body_info     = std::move(snapshot.body_info);
+    body_physics  = std::move(snapshot.body_physics);
+    body_instance = std::move(snapshot.body_instance);
+    names         = std::move(snapshot.names);
+    trajectory_settings = snapshot.trajectory_settings;
+    integrator_settings = snapshot.integrator_settings;
+    live_name_bytes = names.size();
+    reset_handles();
+    // The restored bodies have no tracers, even if the checksum
+    // matches the one the previews were built from
+    trajectories_valid = false;
+}
+
+int Simulation::append_snapshot(const SimulationSnapshot &snapshot)
+{
+    int count = snapshot.body_physics.size();
+    int first = append_bodies(count);
+    std::copy(snapshot.body_physics.begin(), snapshot.body_physics.end(),
+              body_physics.begin() + first);
+    std::copy(snapshot.body_instance.begin(), snapshot.body_instance.end(),
+              body_instance.begin() + first);
+    // Interned directly, as the new bodies only have the shared empty
+    // name, so there is nothing to compact away
+    for (int i = 0; i < count; ++i) {
+        auto name = snapshot.body_info[i].name;
+        auto& info = body_info[first + i];
+        live_name_bytes -= info.name.size() + 1;
+        info.name = names.intern(name);
+        live_name_bytes += name.size() + 1;
+    }
+    return first;
+}
+
+void Simulation::load_simulation(const std::string &path)
 {
-    std::ofstream file(path, std::ios::binary);
+    std::ifstream file(path, std::ios::binary);
     if (file.good()) {
-        file.write(reinterpret_cast<char*>(&num_bodies), sizeof(num_bodies));
-        for (auto &physics : body_physics) {
-            file.write(reinterpret_cast<char*>(&physics), sizeof(physics));
-        }
-        for (auto &instance : body_instance) {
-            file.write(reinterpret_cast<char*>(&instance), sizeof(instance));
-        }
-        for (auto &info : body_info) {
-            auto &name = info.name;
-            auto len   = name.length();
-            file.write(reinterpret_cast<char*>(&len), sizeof(len));
-            file.write(reinterpret_cast<const char*>(name.c_str()), len);
-        }
+        read_simulation(file);
     }
 }
 
+bool Simulation::read_simulation(std::istream &file)
+{
+    SimulationSnapshot loaded;
+    if (!read_snapshot(file, loaded)) {
+        return false;
+    }
+    restore(std::move(loaded));
+    return true;
+}
+
+void Simulation::save_simulation(const std::string &path)
+{
+    // Written to a temporary file first, so a crash part way through 
+    // leaves the previous save intact
+    std::ostringstream file;
+    write_simulation(file);
+    if (!write_file_atomically(path, file.str())) {
+        std::cerr << "Failed to save " << path << "\n";
+    }
+}
+
+void Simulation::write_simulation(std::ostream &file) const
+{
+    write_scene(file, *this);
+}
+
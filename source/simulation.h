@@ -1,15 +1,40 @@
 #pragma once
 
+#include "arena.h"
+#include "wisdom_holman.h"
+
 #include <glm/glm.hpp>
 
 #include <vector>
+#include <atomic>
 #include <string>
+#include <iosfwd>
+#include <string_view>
+#include <span>
+#include <cstdint>
+
+constexpr float GRAV_CONSTANT = 6.674e-3;
 
 struct BodyInfo {
-    std::string name;
+    // Points into the simulation's name arena, always null terminated.
+    // Use Simulation::set_name to change it.
+    std::string_view name;
+    // Positions relative to the body tracers are drawn relative to.
+    // Added with append_tracer, so straight stretches are one segment.
     std::vector<glm::vec3> tracers;
+    // Direction of the last tracer segment when it was started
+    glm::vec3 tracer_direction = glm::vec3(0.0f);
+    // Bumped whenever tracers before the last one are changed or 
+    // removed. Appending only moves or adds the last one, so a renderer
+    // can upload just the end of the tracers until this changes.
+    uint32_t tracer_edits = 0;
 };
 
+// Adds a point to the end of a body's tracers. While the path stays
+// within a small angle of the last segment's starting direction, the
+// segment's end is moved to the point instead of adding a new one.
+void append_tracer(BodyInfo& info, glm::vec3 point);
+
 struct BodyPhysics {
     glm::vec3 position = glm::vec3(0.0f);
     glm::vec3 velocity = glm::vec3(0.0f);
@@ -25,31 +50,162 @@ struct BodyInstance {
     int emits_light;
 };
 
+// Stable reference to a body. Unlike an index into the body arrays, a
+// handle stays valid when other bodies are added or removed, and stops
+// resolving once the body it refers to has been deleted.
+struct BodyHandle {
+    uint32_t slot       = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const BodyHandle&) const = default;
+};
+
+// How far ahead the trajectory previews run. Saved with the scene, 
+// since slow outer orbits need a longer horizon than a tight binary.
+struct TrajectorySettings {
+    int horizon = 1000;     // Steps to run ahead
+    int period  = 10;       // Steps between recorded points
+};
+
+// How the bodies are stepped. Automatic uses Wisdom-Holman when one 
+// body dominates the mass, as in a star with its planets, else Euler.
+enum class IntegratorType {
+    Automatic, Euler, WisdomHolman
+};
+
+constexpr const char *INTEGRATOR_NAMES[] = {
+    "automatic", "euler", "wisdom-holman"
+};
+
+// Saved with the scene, as the right step depends on the system
+struct IntegratorSettings {
+    IntegratorType type = IntegratorType::Automatic;
+    float time_step = 1.0f;
+};
+
+// A copy of the bodies and settings, without the tracers, e.g. for 
+// loading or saving on another thread. Names point into its own arena.
+struct SimulationSnapshot {
+    std::vector<BodyInfo>     body_info;
+    std::vector<BodyPhysics>  body_physics;
+    std::vector<BodyInstance> body_instance;
+    NameArena names;
+    TrajectorySettings trajectory_settings;
+    IntegratorSettings integrator_settings;
+};
+
+// The .sim format. Reading reports its progress from 0 to 1 if asked,
+// and gives up, returning false, once cancel is set.
+bool read_snapshot(std::istream &file, SimulationSnapshot &snapshot,
+                   const std::atomic<bool> *cancel = nullptr,
+                   std::atomic<float> *progress = nullptr);
+void write_snapshot(std::ostream &file, const SimulationSnapshot &snapshot);
+
 enum class SimulationState {
     Waiting, Running, Paused
 };
 
 struct Simulation {
-    static constexpr int NO_BODY = -1;
+    static constexpr BodyHandle NO_BODY {};
+    static constexpr int NO_INDEX = -1;
+    // Steps of the trajectory previews computed straight away. The 
+    // rest stream in over the following updates, within the budget.
+    static constexpr int TRAJECTORY_INITIAL_STEPS = 100;
+    // How many times heavier than the rest combined a body must be
+    // for the automatic integrator to orbit the others around it
+    static constexpr float DOMINANT_MASS_RATIO = 100.0f;
+    // Points kept in a body's trail. The space is reserved on the 
+    // first point, and a full trail thins out its older half.
+    static constexpr int MAX_TRAIL_POINTS = 512;
     int num_updates = 0;
     int num_bodies = 0;
     std::vector<BodyInfo>     body_info;
     std::vector<BodyPhysics>  body_physics;
     std::vector<BodyInstance> body_instance;
     SimulationState state = SimulationState::Waiting;
-    int draw_tracers_relative_to = NO_BODY;
+    BodyHandle draw_tracers_relative_to = NO_BODY;
+    bool record_tracers = true;
+    // Off when something else, e.g. the GPU, computes the previews
+    bool compute_trajectories = true;
+    TrajectorySettings trajectory_settings;
+    // Time per update spent extending the previews, 0 for no limit
+    float trajectory_budget_ms = 4.0f;
+    IntegratorSettings integrator_settings;
+    // Bumped whenever bodies are added, removed or renamed
+    uint64_t body_version = 0;
 
     const BodyInfo& get_info(int index) const;
+    const BodyInfo& get_info(BodyHandle handle) const;
     const BodyPhysics& get_physics(int index) const;
+    const BodyPhysics& get_physics(BodyHandle handle) const;
     const BodyInstance& get_instance(int index) const;
+    int index_of(BodyHandle handle) const;
+    BodyHandle handle_of(int index) const;
+    BodyHandle add_body(const BodyInfo&     info,
+                        const BodyPhysics&  physics,
+                        const BodyInstance& instance);
+    int append_bodies(int count);
+    // Where the tracers are offset from when drawn, i.e. the 
+    // position of the body they're drawn relative to, or zero
+    glm::vec3 tracer_origin() const;
+    // Changes whenever something the trajectory previews depend on does
+    uint64_t trajectory_checksum() const;
+    // The body Wisdom-Holman steps orbit around, or NO_INDEX for Euler
+    int integrator_central_body() const;
+    void set_name(int index, std::string_view name);
     void clear_tracers();
-    void delete_body(int index);
+    void delete_body(BodyHandle handle);
+    void delete_bodies(const std::vector<BodyHandle>& handles);
     void update();
+    SimulationSnapshot snapshot() const;
+    // Replaces the bodies and settings, moving them out of the snapshot
+    void restore(SimulationSnapshot &&snapshot);
+    // Adds the snapshot's bodies after the existing ones, keeping the
+    // settings. Returns the index of the first new body.
+    int append_snapshot(const SimulationSnapshot &snapshot);
     void load_simulation(const std::string &path);
     void save_simulation(const std::string &path);
+    // The .sim format, for embedding in other files. Reading 
+    // returns false, leaving the simulation as it was, if truncated.
+    bool read_simulation(std::istream &file);
+    void write_simulation(std::ostream &file) const;
 
 private:
+    // Slot table mapping handles to positions in the dense body arrays.
+    // A live slot stores the body's index, a free slot stores the next
+    // free slot. Generations are bumped on removal so stale handles fail.
+    struct BodySlot {
+        uint32_t index;
+        uint32_t generation;
+    };
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    std::vector<BodySlot> body_slots;
+    std::vector<uint32_t> slot_of_body;
+    uint32_t free_slot = NO_SLOT;
+
+    // Keeps its workspace between steps
+    WisdomHolman wisdom_holman;
+
+    // Trajectory previews in progress. They are extended a chunk at a 
+    // time, and started again when the checksum of their source changes.
+    std::vector<BodyPhysics> trajectory_state;
+    int trajectory_step = 0;
+    uint64_t trajectory_source = 0;
+    bool trajectories_valid = false;
+
+    // Storage for body names. Renamed and deleted bodies leave their
+    // old names behind, so the arena is compacted once mostly garbage.
+    NameArena names;
+    size_t live_name_bytes = 0;
+
+    uint32_t allocate_slot(uint32_t index);
+    void remove_at(int index);
+    void reset_handles();
+    void compact_names();
     void calculate_trajectories();
+    void step_trajectories();
+    // Advances the bodies by one step of the chosen integrator
+    void step_bodies(std::span<BodyPhysics> bodies);
     void update_positions();
 };
 
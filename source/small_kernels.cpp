@@ -0,0 +1,27 @@
+#include "small_kernels.h"
+
+#include <iterator>
+
+// Indexed by body count, from SMALL_KERNEL_MIN_BODIES
+static constexpr ForceKernel SMALL_FORCE_KERNELS[] = {
+    update_forces_fixed<2>,
+    update_forces_fixed<3>,
+    update_forces_fixed<4>,
+    update_forces_fixed<5>,
+    update_forces_fixed<6>,
+    update_forces_fixed<7>,
+    update_forces_fixed<8>,
+    update_forces_fixed<9>,
+    update_forces_fixed<10>,
+};
+
+static_assert(std::size(SMALL_FORCE_KERNELS)
+              == SMALL_KERNEL_MAX_BODIES - SMALL_KERNEL_MIN_BODIES + 1);
+
+ForceKernel small_force_kernel(int count)
+{
+    if (count < SMALL_KERNEL_MIN_BODIES || count > SMALL_KERNEL_MAX_BODIES) {
+        return nullptr;
+    }
+    return SMALL_FORCE_KERNELS[count - SMALL_KERNEL_MIN_BODIES];
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <array>
+#include <cmath>
+#include <utility>
+
+// Force kernels for scenes of a few bodies, e.g. binary stars, three
+// body problems and the solar system example. With the count known at
+// compile time, every pair is unrolled and each one's pull is worked
+// out once, for both bodies, rather than once from each side.
+constexpr int SMALL_KERNEL_MIN_BODIES = 2;
+constexpr int SMALL_KERNEL_MAX_BODIES = 10;
+
+using ForceKernel = void (*)(BodyPhysics *bodies, float time_step);
+
+// The kernel for this many bodies, or nullptr if there isn't one
+ForceKernel small_force_kernel(int count);
+
+template <int N>
+constexpr auto make_body_pairs()
+{
+    std::array<std::pair<int, int>, N * (N - 1) / 2> pairs {};
+    int next = 0;
+    for (int i = 0; i < N; ++i) {
+        for (int j = i + 1; j < N; ++j) {
+            pairs[next++] = { i, j };
+        }
+    }
+    return pairs;
+}
+
+template <int I, int J>
+inline void add_pair_acceleration(const BodyPhysics *bodies, glm::vec3 *acceleration)
+{
+    constexpr float epsilon = 0.0001;
+
+    glm::vec3 delta = bodies[J].position - bodies[I].position;
+    float r2 = glm::dot(delta, delta);
+    float radius = std::sqrt(r2);
+
+    // Avoid division by 0, as update_forces does
+    if (radius > epsilon) {
+        glm::vec3 pull = delta * (GRAV_CONSTANT / (r2 * radius));
+        acceleration[I] += pull * bodies[J].mass;
+        acceleration[J] -= pull * bodies[I].mass;
+    }
+}
+
+// Same as update_forces for exactly N bodies
+template <int N>
+void update_forces_fixed(BodyPhysics *bodies, float time_step)
+{
+    static constexpr auto pairs = make_body_pairs<N>();
+    glm::vec3 acceleration[N] {};
+
+    [&]<size_t... P>(std::index_sequence<P...>) {
+        (add_pair_acceleration<pairs[P].first, pairs[P].second>(bodies, acceleration), ...);
+    }(std::make_index_sequence<pairs.size()>());
+
+    [&]<size_t... I>(std::index_sequence<I...>) {
+        ((bodies[I].velocity += acceleration[I] * time_step), ...);
+    }(std::make_index_sequence<N>());
+}
@@ -0,0 +1,238 @@
+#include "snapshot_store.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+template <typename T>
+char *put(char *bytes, const T& value)
+{
+    std::memcpy(bytes, &value, sizeof(T));
+    return bytes + sizeof(T);
+}
+
+template <typename T>
+T get(const char *&bytes)
+{
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    bytes += sizeof(T);
+    return value;
+}
+
+}
+
+SnapshotStore::SnapshotStore(size_t budget_bytes)
+    : budget_bytes(budget_bytes)
+{
+}
+
+void SnapshotStore::take(const Simulation& simulation)
+{
+    Snapshot snapshot;
+    snapshot.info = { simulation.num_updates, simulation.num_bodies };
+    snapshot.trajectory_settings = simulation.trajectory_settings;
+    snapshot.integrator_settings = simulation.integrator_settings;
+
+    const Snapshot *previous = snapshots.empty() ? nullptr : &snapshots.back();
+    int num_pages = (simulation.num_bodies + BODIES_PER_PAGE - 1) / BODIES_PER_PAGE;
+    snapshot.pages.resize(num_pages);
+
+    for (int page = 0; page < num_pages; ++page) {
+        int first = page * BODIES_PER_PAGE;
+        int last  = std::min(first + BODIES_PER_PAGE, simulation.num_bodies);
+
+        for (int kind = 0; kind < NUM_PAGE_KINDS; ++kind) {
+            pack(simulation, PageKind(kind), first, last);
+
+            // Share the page if it hasn't changed since the last snapshot
+            if (previous && page < int(previous->pages.size())) {
+                const auto& shared = previous->pages[page][kind];
+                if (*shared == buffer) {
+                    snapshot.pages[page][kind] = shared;
+                    continue;
+                }
+            }
+            snapshot.pages[page][kind] = std::make_shared<const std::vector<char>>(buffer);
+            used_bytes += buffer.size();
+        }
+    }
+
+    snapshots.push_back(std::move(snapshot));
+    trim();
+}
+
+void SnapshotStore::rewind(int index, Simulation& simulation) const
+{
+    const auto& snapshot = snapshots[index];
+    int count = snapshot.info.num_bodies;
+
+    SimulationSnapshot restored;
+    restored.body_info.resize(count);
+    restored.body_physics.resize(count);
+    restored.body_instance.resize(count);
+    restored.trajectory_settings = snapshot.trajectory_settings;
+    restored.integrator_settings = snapshot.integrator_settings;
+
+    for (int page = 0; page < int(snapshot.pages.size()); ++page) {
+        int first = page * BODIES_PER_PAGE;
+        int last  = std::min(first + BODIES_PER_PAGE, count);
+
+        for (int kind = 0; kind < NUM_PAGE_KINDS; ++kind) {
+            unpack(*snapshot.pages[page][kind], PageKind(kind), first, last, restored);
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const auto& physics = restored.body_physics[i];
+        restored.body_instance[i].model = glm::scale(
+            glm::translate(glm::mat4(1.0f), physics.position),
+            glm::vec3(physics.radius));
+    }
+
+    simulation.restore(std::move(restored));
+    simulation.num_updates = snapshot.info.num_updates;
+}
+
+void SnapshotStore::fork(int index, Simulation& simulation) const
+{
+    rewind(index, simulation);
+    for (auto& physics : simulation.body_physics) {
+        physics.orig_position = physics.position;
+        physics.orig_velocity = physics.velocity;
+    }
+    simulation.state = SimulationState::Waiting;
+}
+
+void SnapshotStore::clear()
+{
+    snapshots.clear();
+    used_bytes = 0;
+}
+
+SnapshotStore::Info SnapshotStore::info(int index) const
+{
+    return snapshots[index].info;
+}
+
+void SnapshotStore::set_budget(size_t bytes)
+{
+    budget_bytes = bytes;
+    trim();
+}
+
+void SnapshotStore::pack(const Simulation& simulation, PageKind kind, int first, int last)
+{
+    const auto *physics  = simulation.body_physics.data();
+    const auto *instance = simulation.body_instance.data();
+    const auto *info     = simulation.body_info.data();
+
+    size_t size = 0;
+    switch (kind) {
+    case PageKind::Motion:    size = 2 * sizeof(glm::vec3);                     break;
+    case PageKind::Constants: size = 2 * sizeof(glm::vec3) + 2 * sizeof(float); break;
+    case PageKind::Looks:     size = sizeof(glm::vec3) + sizeof(int);           break;
+    case PageKind::Names:     size = sizeof(uint32_t);                          break;
+    }
+    size *= last - first;
+    if (kind == PageKind::Names) {
+        for (int i = first; i < last; ++i) {
+            size += info[i].name.size();
+        }
+    }
+    buffer.resize(size);
+    char *bytes = buffer.data();
+
+    switch (kind) {
+    case PageKind::Motion:
+        for (int i = first; i < last; ++i) {
+            bytes = put(bytes, physics[i].position);
+            bytes = put(bytes, physics[i].velocity);
+        }
+        break;
+    case PageKind::Constants:
+        for (int i = first; i < last; ++i) {
+            bytes = put(bytes, physics[i].orig_position);
+            bytes = put(bytes, physics[i].orig_velocity);
+            bytes = put(bytes, physics[i].mass);
+            bytes = put(bytes, physics[i].radius);
+        }
+        break;
+    case PageKind::Looks:
+        // The model matrix follows from the physics
+        for (int i = first; i < last; ++i) {
+            bytes = put(bytes, instance[i].colour);
+            bytes = put(bytes, instance[i].emits_light);
+        }
+        break;
+    case PageKind::Names:
+        for (int i = first; i < last; ++i) {
+            auto name = info[i].name;
+            bytes = put(bytes, uint32_t(name.size()));
+            bytes = std::copy(name.begin(), name.end(), bytes);
+        }
+        break;
+    }
+}
+
+void SnapshotStore::unpack(const std::vector<char>& page, PageKind kind, int first, int last,
+                           SimulationSnapshot& restored)
+{
+    const char *bytes = page.data();
+    auto *physics  = restored.body_physics.data();
+    auto *instance = restored.body_instance.data();
+
+    switch (kind) {
+    case PageKind::Motion:
+        for (int i = first; i < last; ++i) {
+            physics[i].position = get<glm::vec3>(bytes);
+            physics[i].velocity = get<glm::vec3>(bytes);
+        }
+        break;
+    case PageKind::Constants:
+        for (int i = first; i < last; ++i) {
+            physics[i].orig_position = get<glm::vec3>(bytes);
+            physics[i].orig_velocity = get<glm::vec3>(bytes);
+            physics[i].mass   = get<float>(bytes);
+            physics[i].radius = get<float>(bytes);
+        }
+        break;
+    case PageKind::Looks:
+        for (int i = first; i < last; ++i) {
+            instance[i].colour      = get<glm::vec3>(bytes);
+            instance[i].emits_light = get<int>(bytes);
+        }
+        break;
+    case PageKind::Names:
+        for (int i = first; i < last; ++i) {
+            auto length = get<uint32_t>(bytes);
+            restored.body_info[i].name = restored.names.intern({ bytes, length });
+            bytes += length;
+        }
+        break;
+    }
+}
+
+void SnapshotStore::drop_oldest()
+{
+    // A page only frees memory once no later snapshot shares it
+    for (const auto& pages : snapshots.front().pages) {
+        for (const auto& page : pages) {
+            if (page.use_count() == 1) {
+                used_bytes -= page->size();
+            }
+        }
+    }
+    snapshots.pop_front();
+}
+
+void SnapshotStore::trim()
+{
+    // The latest is kept even if it alone is over the budget
+    while (used_bytes > budget_bytes && snapshots.size() > 1) {
+        drop_oldest();
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "simulation.h"
+
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// In-memory snapshots of a running simulation, to rewind to or to fork
+// a new run from, without simulating again from the start. Each one is
+// split into pages, by range of bodies and by how often that part of a
+// body changes. A page that's the same as in the previous snapshot is
+// shared with it, so only the positions and velocities are copied on
+// most steps. The oldest snapshots are dropped to stay within a budget.
+class SnapshotStore {
+public:
+    // What the snapshot list shows of each one
+    struct Info {
+        int num_updates;
+        int num_bodies;
+    };
+
+    explicit SnapshotStore(size_t budget_bytes = 256 << 20);
+
+    void take(const Simulation& simulation);
+    // Puts the simulation back as it was at the snapshot. Tracers
+    // aren't kept, so trails start again from there.
+    void rewind(int index, Simulation& simulation) const;
+    // Rewinds, then makes the snapshot the starting point of a new
+    // run, waiting to be edited. Resetting returns to it.
+    void fork(int index, Simulation& simulation) const;
+    void clear();
+
+    int size() const { return snapshots.size(); }
+    Info info(int index) const;
+    // Bytes held in pages, counting shared pages once
+    size_t memory_used() const { return used_bytes; }
+    size_t budget() const { return budget_bytes; }
+    void set_budget(size_t bytes);
+
+private:
+    // The parts of a body, from most to least often changed
+    enum class PageKind {
+        Motion,         // Position and velocity
+        Constants,      // Starting state, mass and radius
+        Looks,          // Colour and light
+        Names
+    };
+    static constexpr int NUM_PAGE_KINDS  = 4;
+    static constexpr int BODIES_PER_PAGE = 256;
+
+    using Page = std::shared_ptr<const std::vector<char>>;
+
+    struct Snapshot {
+        Info info;
+        TrajectorySettings trajectory_settings;
+        IntegratorSettings integrator_settings;
+        std::vector<std::array<Page, NUM_PAGE_KINDS>> pages;
+    };
+
+    std::deque<Snapshot> snapshots;
+    size_t budget_bytes;
+    size_t used_bytes = 0;
+    std::vector<char> buffer;       // Page being packed
+
+    // Fills the buffer with one part of a range of bodies
+    void pack(const Simulation& simulation, PageKind kind, int first, int last);
+    static void unpack(const std::vector<char>& page, PageKind kind, int first, int last,
+                       SimulationSnapshot& restored);
+    void drop_oldest();
+    void trim();
+};
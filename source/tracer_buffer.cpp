@@ -0,0 +1,58 @@
+#include "tracer_buffer.h"
+
+#include <algorithm>
+
+void TracerBuffer::update(const Simulation& simulation, GLVertexBuffer& vbo)
+{
+    int num_bodies = simulation.num_bodies;
+    int needed = 1;
+    for (int i = 0; i < num_bodies; ++i) {
+        needed = std::max<int>(needed, simulation.get_info(i).tracers.capacity());
+    }
+
+    // Lay the regions out again when a body moves or outgrows its
+    // region. Tracers reserve their capacity up front, so this is rare.
+    bool relayout = needed > stride 
+                 || num_bodies != int(uploaded.size())
+                 || simulation.body_version != body_version;
+    if (relayout) {
+        stride = needed;
+        body_version = simulation.body_version;
+        uploaded.assign(num_bodies, Uploaded{ 0, 0 });
+        firsts.resize(num_bodies);
+        counts.resize(num_bodies);
+
+        size_t size = sizeof(glm::vec3) * stride * num_bodies;
+        if (size > allocated) {
+            vbo.allocate(size, GL_DYNAMIC_DRAW);
+            allocated = size;
+        }
+    }
+
+    for (int i = 0; i < num_bodies; ++i) {
+        const auto& info    = simulation.get_info(i);
+        const auto& tracers = info.tracers;
+        auto& done  = uploaded[i];
+        int   count = tracers.size();
+
+        // The last uploaded point may have been moved since
+        int from = (relayout || done.edits != info.tracer_edits)
+            ? 0
+            : std::max(std::min(done.count, count) - 1, 0);
+        if (from < count) {
+            size_t offset = sizeof(glm::vec3) * (size_t(i) * stride + from);
+            vbo.set_sub_data(offset, tracers.data() + from, count - from);
+        }
+
+        done      = Uploaded{ info.tracer_edits, count };
+        firsts[i] = i * stride;
+        counts[i] = count;
+    }
+}
+
+void TracerBuffer::draw() const
+{
+    if (!firsts.empty()) {
+        glMultiDrawArrays(GL_LINE_STRIP, firsts.data(), counts.data(), firsts.size());
+    }
+}
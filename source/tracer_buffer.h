@@ -0,0 +1,35 @@
+#pragma once
+
+#include "simulation.h"
+#include "gl_objects.h"
+
+#include <vector>
+
+// Keeps every body's tracers in one vertex buffer, so they're drawn
+// with a single glMultiDrawArrays call. Each body has a region of the
+// buffer as long as the largest tracer capacity, so appending never
+// moves another body's points. Appending only moves or adds the last
+// point, so just the points from the last uploaded one on are sent 
+// again, unless the body's tracer_edits show earlier ones changed.
+class TracerBuffer {
+public:
+    // Uploads what changed since the last update into vbo, which
+    // must be the same buffer every time
+    void update(const Simulation& simulation, GLVertexBuffer& vbo);
+    // Draws each body's tracers as a line strip, with the vertex
+    // array for vbo and the line shader bound
+    void draw() const;
+
+private:
+    struct Uploaded {
+        uint32_t edits;
+        int count;
+    };
+
+    int stride = 0;         // Points per body region
+    size_t allocated = 0;   // Bytes of storage in the buffer
+    uint64_t body_version = 0;
+    std::vector<Uploaded> uploaded;
+    std::vector<GLint>   firsts;
+    std::vector<GLsizei> counts;
+};
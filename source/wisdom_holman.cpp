@@ -0,0 +1,188 @@
+#include "wisdom_holman.h"
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+// Stumpff functions c2(z) and c3(z), with series near zero where
+// the closed forms lose their precision
+static void stumpff(double z, double& c2, double& c3)
+{
+    if (z > 1e-4) {
+        double s = std::sqrt(z);
+        c2 = (1.0 - std::cos(s)) / z;
+        c3 = (s - std::sin(s)) / (z * s);
+    } else if (z < -1e-4) {
+        double s = std::sqrt(-z);
+        c2 = (std::cosh(s) - 1.0) / -z;
+        c3 = (std::sinh(s) - s) / (-z * s);
+    } else {
+        c2 = 1.0 / 2.0 - z / 24.0 + z * z / 720.0;
+        c3 = 1.0 / 6.0 - z / 120.0 + z * z / 5040.0;
+    }
+}
+
+void kepler_drift(glm::dvec3& position, glm::dvec3& velocity, double mu, double time)
+{
+    constexpr double epsilon = 0.0001;
+    constexpr int max_iterations = 50;
+
+    double r0 = glm::length(position);
+    if (r0 <= epsilon || mu <= 0.0) {
+        position += velocity * time;
+        return;
+    }
+
+    double sqrt_mu = std::sqrt(mu);
+    double r0_dot_v0 = glm::dot(position, velocity) / sqrt_mu;
+    // Reciprocal of the semi-major axis, negative when unbound
+    double alpha = 2.0 / r0 - glm::dot(velocity, velocity) / mu;
+
+    // Whole periods of a bound orbit change nothing
+    if (alpha > 0.0) {
+        double period = 2.0 * std::numbers::pi / (sqrt_mu * std::pow(alpha, 1.5));
+        time = std::fmod(time, period);
+    }
+
+    // Solve Kepler's equation for the universal anomaly chi by Newton's
+    // method. The derivative of the equation is the new radius.
+    double chi = alpha > 0.0
+        ? sqrt_mu * time * alpha
+        : sqrt_mu * time / r0;
+    double c2, c3, z, radius;
+    for (int i = 0; i < max_iterations; ++i) {
+        z = alpha * chi * chi;
+        stumpff(z, c2, c3);
+        double chi2 = chi * chi;
+        radius = chi2 * c2 + r0_dot_v0 * chi * (1.0 - z * c3) + r0 * (1.0 - z * c2);
+        double error = r0_dot_v0 * chi2 * c2 + (1.0 - alpha * r0) * chi2 * chi * c3
+                     + r0 * chi - sqrt_mu * time;
+        double delta = error / radius;
+        chi -= delta;
+        if (std::abs(delta) <= 1e-13 * std::max(1.0, std::abs(chi))) {
+            break;
+        }
+    }
+
+    z = alpha * chi * chi;
+    stumpff(z, c2, c3);
+    double chi2 = chi * chi;
+
+    // Lagrange coefficients, giving the new state from the old one
+    double f = 1.0 - chi2 / r0 * c2;
+    double g = time - chi2 * chi / sqrt_mu * c3;
+    glm::dvec3 new_position = f * position + g * velocity;
+    radius = glm::length(new_position);
+    double f_dot = sqrt_mu / (radius * r0) * chi * (z * c3 - 1.0);
+    double g_dot = 1.0 - chi2 / radius * c2;
+
+    velocity = f_dot * position + g_dot * velocity;
+    position = new_position;
+}
+
+void WisdomHolman::kick(std::span<const BodyPhysics> bodies, int central, double time)
+{
+    constexpr double epsilon = 0.0001;
+
+    // Pulls between the orbiting bodies. The central body's is
+    // in the Kepler orbits, so it's skipped.
+    int count = bodies.size();
+    for (int i = 0; i < count; ++i) {
+        if (i == central) {
+            continue;
+        }
+        for (int j = i + 1; j < count; ++j) {
+            if (j == central) {
+                continue;
+            }
+            glm::dvec3 delta = positions[j] - positions[i];
+            double r2 = glm::dot(delta, delta);
+            double radius = std::sqrt(r2);
+            if (radius > epsilon) {
+                glm::dvec3 pull = delta * (GRAV_CONSTANT * time / (r2 * radius));
+                velocities[i] += pull * double(bodies[j].mass);
+                velocities[j] -= pull * double(bodies[i].mass);
+            }
+        }
+    }
+}
+
+void WisdomHolman::jump(std::span<const BodyPhysics> bodies, int central, double time)
+{
+    // Moves the bodies with the central body's reaction to them
+    glm::dvec3 momentum(0.0);
+    int count = bodies.size();
+    for (int i = 0; i < count; ++i) {
+        if (i != central) {
+            momentum += velocities[i] * double(bodies[i].mass);
+        }
+    }
+    glm::dvec3 offset = momentum * (time / bodies[central].mass);
+    for (int i = 0; i < count; ++i) {
+        if (i != central) {
+            positions[i] += offset;
+        }
+    }
+}
+
+void WisdomHolman::step(std::span<BodyPhysics> bodies, int central, float time_step)
+{
+    int count = bodies.size();
+    double dt = time_step;
+    double central_mass = bodies[central].mass;
+
+    double total_mass = 0.0;
+    glm::dvec3 centre(0.0);
+    glm::dvec3 centre_velocity(0.0);
+    for (const auto& body : bodies) {
+        total_mass      += body.mass;
+        centre          += glm::dvec3(body.position) * double(body.mass);
+        centre_velocity += glm::dvec3(body.velocity) * double(body.mass);
+    }
+    centre          /= total_mass;
+    centre_velocity /= total_mass;
+
+    // Into democratic heliocentric coordinates
+    positions.resize(count);
+    velocities.resize(count);
+    glm::dvec3 central_position(bodies[central].position);
+    for (int i = 0; i < count; ++i) {
+        positions[i]  = glm::dvec3(bodies[i].position) - central_position;
+        velocities[i] = glm::dvec3(bodies[i].velocity) - centre_velocity;
+    }
+
+    kick(bodies, central, dt / 2.0);
+    jump(bodies, central, dt / 2.0);
+    double mu = GRAV_CONSTANT * central_mass;
+    for (int i = 0; i < count; ++i) {
+        if (i != central) {
+            kepler_drift(positions[i], velocities[i], mu, dt);
+        }
+    }
+    jump(bodies, central, dt / 2.0);
+    kick(bodies, central, dt / 2.0);
+
+    // Back to positions and velocities, with the
+    // barycentre moving on at its constant velocity
+    centre += centre_velocity * dt;
+    glm::dvec3 weighted_position(0.0);
+    glm::dvec3 momentum(0.0);
+    for (int i = 0; i < count; ++i) {
+        if (i != central) {
+            weighted_position += positions[i] * double(bodies[i].mass);
+            momentum          += velocities[i] * double(bodies[i].mass);
+        }
+    }
+    central_position = centre - weighted_position / total_mass;
+    for (int i = 0; i < count; ++i) {
+        auto& body = bodies[i];
+        if (i == central) {
+            body.position = glm::vec3(central_position);
+            body.velocity = glm::vec3(centre_velocity - momentum / central_mass);
+        } else {
+            body.position = glm::vec3(central_position + positions[i]);
+            body.velocity = glm::vec3(centre_velocity + velocities[i]);
+        }
+    }
+}
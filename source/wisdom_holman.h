@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <span>
+#include <vector>
+
+struct BodyPhysics;
+
+// Advances a body on a Kepler orbit around a fixed mass, G * mass = mu,
+// exactly rather than by small steps. Uses the universal variable form,
+// so elliptic, parabolic and hyperbolic orbits are all handled.
+void kepler_drift(glm::dvec3& position, glm::dvec3& velocity, double mu, double time);
+
+// Wisdom-Holman integrator for systems with one dominant mass, such as
+// a star and its planets, in democratic heliocentric coordinates. Each
+// body's orbit around the central body is advanced exactly, and only
+// the pulls between the other bodies are applied as kicks, half a step
+// either side. Their orbits are followed accurately with steps far
+// longer than update_forces needs.
+class WisdomHolman {
+public:
+    void step(std::span<BodyPhysics> bodies, int central, float time_step);
+
+private:
+    // Kept between steps, so steady-state steps don't allocate
+    std::vector<glm::dvec3> positions;    // Relative to the central body
+    std::vector<glm::dvec3> velocities;   // Relative to the barycentre
+
+    void kick(std::span<const BodyPhysics> bodies, int central, double time);
+    void jump(std::span<const BodyPhysics> bodies, int central, double time);
+};